@@ -3,14 +3,17 @@
  * 
  * NOTES:
  * http://www.ummon.eu/Linux/API/Devices/framebuffer.html
- * 
- * TODOS:
- * - make dedicated canvas frame handler (currently the canvas frame is actually screen-sized)
+ * build with: g++ -O3 -pthread warzone.cpp -o warzone
+ * (-O3 is needed for the entity and projectile passes to vectorize; GCC's
+ * -O2 cost model skips loops whose trip count isn't known up front)
+ * benchmark primitives with: ./warzone --bench [--json] [--seed N]
  * 
  */
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
@@ -19,10 +22,23 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <termios.h>
+#include <time.h>
+#include <stdint.h>
+#include <limits.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <cmath>
 #include <algorithm>
+#include <map>
 #include <iostream>
 
 #define min(X,Y) (((X) < (Y)) ? (X) : (Y))
@@ -33,10 +49,28 @@
 #define degreesToRadians(angleDegrees) (angleDegrees * M_PI / 180.0)
 
 /* SETTINGS ------------------------------------------------------------ */
-#define screenXstart 250
-#define screenX 1366
-#define screenY 768
+#define defaultScreenX 1366 // size of the memory outputs unless --size says otherwise
+#define defaultScreenY 768
 #define mouseSensitivity 1
+#define inputQueueSize 256 // events waiting for the frame loop, a power of two
+#define maxDirtyRects 32
+#define tileSize 64
+#define defaultTickRate 60 // simulation ticks per second
+#define maxTicksPerFrame 8 // further behind than this, the simulation slows down instead
+#define maxTickMove 64 // per-tick moves longer than this are jumps, not interpolated
+#define maxEntities 8192
+#define maxProjectiles 4096 // rounds in flight at once
+#define maxParticles 131072
+#define profileFrames 8192 // frames the profiler keeps, older ones are overwritten
+#define hudFrames 120 // frames the overlay's statistics cover
+#define defaultExplosionParticles 2000 // default sparks and debris thrown by a downed plane
+#define cannonFireTicks 45 // default ticks between a cannon's shots
+#define collisionCell 64 // side of a broad-phase grid cell, in pixels
+#define collisionGridX 64
+#define collisionGridY 32
+#define maxTargetCells 12 // grid cells a target's box can touch, 4 across and 3 down
+#define collisionMargin 256 // the grid starts this far up and left of the canvas
+#define hugePageSize (2 << 20) // what surface arenas are rounded up and aligned to
 
 using namespace std;
 
@@ -49,9 +83,47 @@ typedef struct s_rgb {
 	unsigned char b;
 } RGB;
 
-//Frame of RGBs
+//packed 32-bit pixel, bytes laid out B,G,R,A in memory like the framebuffer
+typedef uint32_t Pixel;
+
+//Rectangle, half-open: [x0,x1) x [y0,y1)
+typedef struct s_rect {
+	int x0;
+	int y0;
+	int x1;
+	int y1;
+} Rect;
+
+//Dirty rectangles of the frame being drawn (cur) and of the one before it (prev)
+typedef struct s_damage {
+	Rect cur[maxDirtyRects];
+	int curCount;
+	Rect prev[maxDirtyRects];
+	int prevCount;
+} Damage;
+
+struct s_renderer;
+
+//One mapping that frames are carved out of, 64-byte aligned each, and that
+//goes back to the system as a whole
+typedef struct s_arena {
+	char* base;
+	size_t size;
+	size_t used;
+	const char* pages; // hugetlb, thp or 4k, whatever the kernel gave us
+} Arena;
+
+//Surface of Pixels, row-major so that each scanline is contiguous. A Frame is
+//only a view: copies share the pixels, e.g. to draw one tile with a smaller clip.
 typedef struct s_frame {
-	RGB px[screenX][screenY];
+	Pixel* px; // pixel (x,y) is px[y*stride + x], see createFrame()
+	int width;
+	int height;
+	int stride; // pixels per row, every row starts 64-byte aligned
+	Rect clip; // drawing outside it is dropped
+	Damage* damage; // draw calls report here when not NULL
+	struct s_renderer* renderer; // draw calls are recorded here instead of drawn when not NULL
+	Arena* arena; // the pixels belong to it when not NULL, see createArenaFrame()
 } Frame;
 
 //Coordinate System
@@ -60,14 +132,247 @@ typedef struct s_coord {
 	int y;
 } Coord;
 
+//Kinds of scene entities, in the order they are drawn
+enum {
+	entityShip, // with its cannon and gunner
+	entityPlane,
+	entityParachute,
+	entityWalker,
+	entityBaling, // a plane's propeller
+	entityKinds
+};
+
+// wrapX of entities that never wrap around
+#define noWrap (-0x7fffffff)
+
+//Scene entities as parallel component arrays, so that update passes stream
+//through memory and vectorize. Slots [0,count) are in use, dead ones
+//included: spawning only appends and a killed entity keeps its slot, since
+//the world holds on to slot numbers and a plane's propeller sits right after
+//it. The store only grows; once maxEntities is reached spawns return -1. The
+//scene spawns its entities once, so only --crowd gets near that.
+typedef struct s_entities {
+	int count;
+	int kind[maxEntities];
+	unsigned char alive[maxEntities];
+	int x[maxEntities] __attribute__((aligned(64))); // position at the newest tick
+	int y[maxEntities] __attribute__((aligned(64)));
+	int prevX[maxEntities] __attribute__((aligned(64))); // position a tick earlier, to interpolate from
+	int prevY[maxEntities] __attribute__((aligned(64)));
+	int vx[maxEntities] __attribute__((aligned(64))); // pixels per tick
+	int vy[maxEntities] __attribute__((aligned(64)));
+	int wrapX[maxEntities] __attribute__((aligned(64))); // at or left of this x it reappears at wrapToX
+	int wrapToX[maxEntities] __attribute__((aligned(64)));
+	int life[maxEntities] __attribute__((aligned(64))); // ticks left, -1 lives forever
+	int sprite[maxEntities]; // cached shape drawn at the position, -1 for none
+	int size[maxEntities]; // parachute radius
+	int fireEvery[maxEntities]; // ticks between a cannon's shots, 0 holds fire
+	int reload[maxEntities]; // ticks until the next shot
+	int anim[maxEntities]; // frame of the walk cycle
+} Entities;
+
+//Rounds in flight, packed in [0,count) so that passes only touch live ones.
+//The slots past count are the free list: spawning takes the first of them,
+//despawning moves the last live round into the hole.
+typedef struct s_projectiles {
+	int count;
+	int x[maxProjectiles] __attribute__((aligned(64)));
+	int y[maxProjectiles] __attribute__((aligned(64)));
+	int prevX[maxProjectiles] __attribute__((aligned(64)));
+	int prevY[maxProjectiles] __attribute__((aligned(64)));
+	int vx[maxProjectiles] __attribute__((aligned(64)));
+	int vy[maxProjectiles] __attribute__((aligned(64)));
+} Projectiles;
+
+//Sparks and debris, packed in [0,count) like the rounds. Positions are in
+//canvas pixels but kept fractional, so slow particles still drift.
+typedef struct s_particles {
+	int count;
+	float x[maxParticles] __attribute__((aligned(64)));
+	float y[maxParticles] __attribute__((aligned(64)));
+	float prevX[maxParticles] __attribute__((aligned(64))); // a tick earlier
+	float prevY[maxParticles] __attribute__((aligned(64)));
+	float vx[maxParticles] __attribute__((aligned(64))); // pixels per tick
+	float vy[maxParticles] __attribute__((aligned(64)));
+	int life[maxParticles] __attribute__((aligned(64))); // ticks left
+	int span[maxParticles]; // ticks it lived for in all, its color fades over them
+	RGB color[maxParticles];
+} Particles;
+
+//A target filed under a grid cell, with its box on the canvas
+typedef struct s_cellEntry {
+	Rect box;
+	int target; // entity slot
+} CellEntry;
+
+//Uniform grid listing the targets whose box touches each cell, rebuilt every
+//tick. Entries of a cell are contiguous, so a lookup reads one short run.
+typedef struct s_collisionGrid {
+	int cellStart[collisionGridX*collisionGridY + 1]; // cell c lists entries [cellStart[c], cellStart[c+1])
+	int cellFill[collisionGridX*collisionGridY];
+	CellEntry entries[maxEntities*maxTargetCells];
+} CollisionGrid;
+
+//Everything the simulation advances per tick
+typedef struct s_world {
+	int canvasWidth;
+	int canvasHeight;
+	int tick; // index of the newest tick, -1 before the first one
+	Entities entities;
+	// the story: the first ship shoots down the first plane, whose pilot bails out
+	int ship, plane, baling; // entity slots
+	int fireEvery; // ticks between shots of cannons spawned from now on
+	Projectiles projectiles;
+	CollisionGrid grid;
+	Particles particles;
+	int explosionParticles; // thrown by a downed plane
+	unsigned int effectSeed; // randomizes the particles, the same way every run
+	int isXploded;
+	int deployed;
+	int parachute; // entity slot once deployed
+	int stickmanEncounter;
+} World;
+
+//Kinds of recorded draw commands
+enum {
+	cmdClear,
+	cmdLine,
+	cmdLineWidth,
+	cmdCircle,
+	cmdHalfCircle,
+	cmdFill,
+	cmdSprite,
+	cmdEllipse,
+	cmdStreaks,
+	cmdTypes
+};
+
+//Shapes kept in the sprite cache
+enum {
+	spriteShip,
+	spritePlane,
+	spriteCannon,
+	spriteBomb,
+	spritePeluru
+};
+
+//Horizontal run of covered sprite pixels [x0,x1) on row y, relative to the anchor
+typedef struct s_spriteRun {
+	short y;
+	short x0;
+	short x1;
+} SpriteRun;
+
+//A static shape rasterized once, kept as runs of covered pixels
+typedef struct s_sprite {
+	int shape;
+	Pixel color;
+	Rect box; // relative to the anchor
+	vector<SpriteRun> runs;
+} Sprite;
+
+//Every sprite traced so far, keyed by shape and color, and the frame they are
+//traced in. Map nodes never move, so a Sprite* stays valid until the teardown.
+typedef struct s_spriteCache {
+	map<pair<int, Pixel>, Sprite> sprites;
+	Frame scratch;
+	Damage scratchDamage;
+} SpriteCache;
+
+//Short line a particle left over its last tick, a point when it barely moved
+typedef struct s_streak {
+	int x0, y0, x1, y1;
+	RGB color;
+} Streak;
+
+//One recorded draw call. x0..y1 hold the line endpoints, the circle center and
+//radius, or the fill offset and scanline range, depending on type.
+typedef struct s_drawCmd {
+	int type;
+	Rect box; // pixels it may touch, used for binning
+	int x0, y0, x1, y1;
+	float wd;
+	RGB color;
+	int polyStart, polyCount; // cmdFill vertices in Renderer.polys, cmdStreaks lines in Renderer.streaks
+	const Sprite* sprite; // cmdSprite only, drawn with its anchor at (x0,y0)
+	float arcFrom, arcTo; // cmdEllipse only, see rasterEllipse()
+	int smooth;
+} DrawCmd;
+
+//Records a frame's draw calls, bins them into screen tiles and rasterizes the
+//tiles on a pool of threads. Its frames can't be larger than the size it was
+//started with.
+typedef struct s_renderer {
+	vector<DrawCmd> cmds;
+	vector<Coord> polys;
+	vector<Streak> streaks; // grouped by the tile they are drawn in
+	int tilesX, tilesY;
+	vector< vector<int> > tiles; // command indices per tile, in draw order
+	vector<int> tileStart, tileFill; // scratch for sorting streaks into tiles
+	vector< vector<int> > batchScratch; // one per thread, for batchTileCmds()
+	Frame* target;
+	// worker pool
+	int threadCount; // including the calling thread
+	vector<thread> workers;
+	mutex lock;
+	condition_variable wake;
+	condition_variable done;
+	int generation;
+	int busy;
+	int quit;
+	atomic<int> nextTile;
+	atomic<long long> workerPixels; // written by the pool threads, for profiling
+} Renderer;
+
+struct s_frameBuffer;
+
+//converts a row of n packed pixels into a fixed native format at dst
+typedef void (*PresentRowFunc)(char* dst, const Pixel* src, int n);
+
+//appends the finished frame to a file output
+typedef void (*WriteFrameFunc)(struct s_frameBuffer* fb);
+
 //The integrated frame buffer plus info struct.
 typedef struct s_frameBuffer {
 	char* ptr;
+	int width; // visible pixels, as far as they fit in a line and the mapping
+	int height;
 	int smemLen;
-	int lineLen;
+	int lineLen; // bytes from one row to the next, can be more than width needs
 	int bpp;
+	// channel layout reported by the driver
+	int redOffset, redLength;
+	int greenOffset, greenLength;
+	int blueOffset, blueLength;
+	int transpOffset, transpLength;
+	// row converter picked once by choosePresentKernel(), NULL means presentRowGeneric
+	PresentRowFunc presentRow;
+	const char* presentName;
+	// page flipping, see setupPageFlip()
+	int fd;
+	char* base; // start of the mapping, ptr points into the page being drawn
+	struct fb_var_screeninfo var;
+	int pageCount; // 2 when the driver pans between two pages, 1 otherwise
+	int backPage;
+	int vsync; // wait for vertical retrace before flipping
+	Rect pending[2][maxDirtyRects]; // damage each page hasn't caught up on yet
+	int pendingCount[2];
+	struct fb_var_screeninfo savedVar; // mode to restore on exit
+	// where frames go, see openFramebufferOutput() and openMemoryOutput()
+	int output;
+	FILE* sink; // file outputs only
+	unsigned char* sinkRow;
+	WriteFrameFunc writeFrame; // picked by chooseSinkKernel()
 } FrameBuffer;
 
+//Output backends
+enum {
+	outputFramebuffer, // the real display
+	outputMemory,      // a 32bpp BGRA buffer that nobody looks at
+	outputPPM,         // memory, then every frame appended to a file as a binary PPM
+	outputRaw          // memory, then every frame appended to a file as raw BGRA
+};
+
 
 /* MATH STUFF ---------------------------------------------------------- */
 
@@ -99,402 +404,2101 @@ unsigned char isInBound(Coord position, Coord corner1, Coord corner2) {
 	return xInBound&&yInBound;
 }
 
+// xorshift32, so every libc generates the same sequence from a seed. A zero
+// state stays zero, so seeds must be nonzero.
+unsigned int randomNext(unsigned int* state) {
+	unsigned int x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+// uniform in lo..hi inclusive
+int randomRange(unsigned int* state, int lo, int hi) {
+	return lo + (int)(randomNext(state) % (unsigned int)(hi - lo + 1));
+}
+
+/* FAST TRIG ----------------------------------------------------------- */
+
+//sin and cos of every whole degree, 16.16 fixed point
+typedef struct s_trigTable {
+	int sin[360];
+	int cos[360];
+} TrigTable;
+
+TrigTable makeTrigTable() {
+	TrigTable t;
+	int d;
+	for (d=0; d<360; d++) {
+		t.sin[d] = (int)lround(sin(d * PI / 180) * 65536);
+		t.cos[d] = (int)lround(cos(d * PI / 180) * 65536);
+	}
+	return t;
+}
+
+const TrigTable trig = makeTrigTable();
+
+// wrap any angle in degrees into 0..359
+int degreeIndex(int degree) {
+	degree %= 360;
+	return degree < 0 ? degree + 360 : degree;
+}
+
+//Rotation about a pivot, with sin/cos looked up once for a whole object
+typedef struct s_rotation {
+	int cx;
+	int cy;
+	int s;
+	int c;
+} Rotation;
+
+Rotation rotation(Coord pivot, int degree) {
+	Rotation rot;
+	int d = degreeIndex(degree);
+	rot.cx = pivot.x;
+	rot.cy = pivot.y;
+	rot.s = trig.sin[d];
+	rot.c = trig.cos[d];
+	return rot;
+}
+
+// rotate n vertices in place; branch-free so the compiler can vectorize it
+void rotateVertices(const Rotation* rot, Coord* v, int n) {
+	int i;
+	for (i=0; i<n; i++) {
+		int dx = v[i].x - rot->cx;
+		int dy = v[i].y - rot->cy;
+		int x = (dx * rot->c - dy * rot->s + 0x8000) >> 16;
+		int y = (dx * rot->s + dy * rot->c + 0x8000) >> 16;
+		v[i].x = x + rot->cx;
+		v[i].y = y + rot->cy;
+	}
+}
+
 /* MOUSE OPERATIONS ---------------------------------------------------- */
 
 // get mouse coord, with integrated screen-space bounding
-Coord getCursorCoord(Coord* mc) {
+Coord getCursorCoord(Coord* mc, int width, int height) {
 	Coord xy;
 	if (mc->x < 0) {
 		mc->x = 0;
 		xy.x = 0;
-	} else if (mc->x >= screenX*mouseSensitivity) {
-		mc->x = screenX*mouseSensitivity-1;
-		xy.x = screenX-1;
+	} else if (mc->x >= width*mouseSensitivity) {
+		mc->x = width*mouseSensitivity-1;
+		xy.x = width-1;
 	} else {
 		xy.x = (int) mc->x / mouseSensitivity;
 	}
 	if (mc->y < 0) {
 		mc->y = 0;
 		xy.y = 0;
-	} else if (mc->y >= screenY*mouseSensitivity) {
-		mc->y = screenY*mouseSensitivity-1;
-		xy.y = screenY-1;
+	} else if (mc->y >= height*mouseSensitivity) {
+		mc->y = height*mouseSensitivity-1;
+		xy.y = height-1;
 	} else {
 		xy.y = (int) mc->y / mouseSensitivity;
 	}
 	return xy;
 }
 
-/* VIDEO OPERATIONS ---------------------------------------------------- */
+/* INPUT --------------------------------------------------------------- */
+// A thread of its own waits on the mouse and the terminal, so the frame loop
+// never blocks on them. What it reads goes through a single producer, single
+// consumer ring that the frame loop drains at the start of each frame.
 
-// construct RGB
-RGB rgb(unsigned char r, unsigned char g, unsigned char b) {
-	RGB retval;
-	retval.r = r;
-	retval.g = g;
-	retval.b = b;
-	return retval;
+//Kinds of input event
+enum {
+	inputCursor, // the cursor moved or a button changed
+	inputKey // a byte typed on the terminal
+};
+
+typedef struct {
+	int type;
+	Coord cursor; // screen position, for inputCursor
+	int buttons; // bit 0 left, 1 right, 2 middle
+	int key;
+} InputEvent;
+
+typedef struct {
+	InputEvent events[inputQueueSize];
+	atomic<unsigned int> head; // written by the input thread only
+	atomic<unsigned int> tail; // written by the frame loop only
+} InputQueue;
+
+typedef struct {
+	InputQueue queue;
+	int mouseFd; // -1 without a mouse
+	int wake[2]; // written to stop the thread
+	int keysFd; // stdin, -1 when it is a terminal we are in the background of
+	int rawTerminal; // stdin was switched to raw mode and needs restoring
+	struct termios savedTerminal;
+	Coord mouse; // mouse internal counter
+	int buttons;
+	int width, height; // screen the cursor stays on
+	thread worker;
+} Input;
+
+// producer side; a full queue drops the event rather than wait for the frame loop
+int pushInput(InputQueue* q, InputEvent ev) {
+	unsigned int head = q->head.load(memory_order_relaxed);
+	if (head - q->tail.load(memory_order_acquire) >= inputQueueSize) {
+		return 0;
+	}
+	q->events[head & (inputQueueSize - 1)] = ev;
+	q->head.store(head + 1, memory_order_release);
+	return 1;
 }
 
-// insert pixel to composition frame, with bounds filter
-void insertPixel(Frame* frm, Coord loc, RGB col) {
-	// do bounding check:
-	if (!(loc.x >= screenX || loc.x < 0 || loc.y >= screenY || loc.y < 0)) {
-		frm->px[loc.x][loc.y].r = col.r;
-		frm->px[loc.x][loc.y].g = col.g;
-		frm->px[loc.x][loc.y].b = col.b;
+// consumer side, 0 when there is nothing waiting
+int popInput(InputQueue* q, InputEvent* ev) {
+	unsigned int tail = q->tail.load(memory_order_relaxed);
+	if (tail == q->head.load(memory_order_acquire)) {
+		return 0;
 	}
+	*ev = q->events[tail & (inputQueueSize - 1)];
+	q->tail.store(tail + 1, memory_order_release);
+	return 1;
 }
 
-// delete contents of composition frame
-void flushFrame (Frame* frm, RGB color) {
-	int x;
-	int y;
-	for (y=0; y<screenY; y++) {
-		for (x=0; x<screenX; x++) {
-			frm->px[x][y] = color;
-		}
+// turn mouse packets (buttons, dx, dy) into cursor events
+void readMouse(Input* in) {
+	signed char packets[3*32];
+	int n = read(in->mouseFd, packets, sizeof(packets));
+	int i;
+	for (i=0; i+3<=n; i+=3) {
+		in->mouse.x += packets[i+1];
+		in->mouse.y -= packets[i+2]; // the mouse counts up, the screen down
+		in->buttons = packets[i] & 7;
+		InputEvent ev;
+		ev.type = inputCursor;
+		ev.cursor = getCursorCoord(&in->mouse, in->width, in->height);
+		ev.buttons = in->buttons;
+		ev.key = 0;
+		pushInput(&in->queue, ev);
 	}
 }
 
-// copy composition Frame to FrameBuffer
-void showFrame (Frame* frm, FrameBuffer* fb) {
-	int x;
-	int y;
-	for (y=0; y<screenY; y++) {
-		for (x=0; x<screenX; x++) {
-			int location = x * (fb->bpp/8) + y * fb->lineLen;
-			*(fb->ptr + location    ) = frm->px[x][y].b; // blue
-			*(fb->ptr + location + 1) = frm->px[x][y].g; // green
-			*(fb->ptr + location + 2) = frm->px[x][y].r; // red
-			*(fb->ptr + location + 3) = 255; // transparency
-		}
+// every byte read from the terminal is a key event; 0 once it is closed
+int readKeys(Input* in) {
+	unsigned char keys[64];
+	int n = read(in->keysFd, keys, sizeof(keys));
+	int i;
+	for (i=0; i<n; i++) {
+		InputEvent ev;
+		ev.type = inputKey;
+		ev.cursor = coord(0,0);
+		ev.buttons = in->buttons;
+		ev.key = keys[i];
+		pushInput(&in->queue, ev);
 	}
+	return n > 0 || (n < 0 && errno == EINTR);
 }
 
-void showCanvas(Frame* frm, Frame* cnvs, int canvasWidth, int canvasHeight, Coord loc, RGB borderColor, int isBorder) {
-	int x, y;
-	for (y=0; y<canvasHeight;y++) {
-		for (x=0; x<canvasWidth; x++) {
-			insertPixel(frm, coord(loc.x - canvasWidth/2 + x, loc.y - canvasHeight/2 + y), cnvs->px[x][y]);
-		}
+void inputWorker(Input* in) {
+	struct pollfd fds[3];
+	fds[0].fd = in->wake[0];
+	fds[1].fd = in->mouseFd;
+	fds[2].fd = in->keysFd;
+	int i;
+	for (i=0; i<3; i++) {
+		fds[i].events = POLLIN;
 	}
-	
-	//show border
-	if(isBorder){
-		for (y=0; y<canvasHeight; y++) {
-			insertPixel(frm, coord(loc.x - canvasWidth/2 - 1, loc.y - canvasHeight/2 + y), borderColor);
-			insertPixel(frm, coord(loc.x  - canvasWidth/2 + canvasWidth, loc.y - canvasHeight/2 + y), borderColor);
+	while (1) {
+		if (poll(fds, 3, -1) < 0) {
+			if (errno == EINTR) continue;
+			return;
+		}
+		if (fds[0].revents) {
+			return;
+		}
+		if (fds[1].revents & POLLIN) {
+			readMouse(in);
+		} else if (fds[1].revents) {
+			fds[1].fd = -1; // the mouse went away
 		}
-		for (x=0; x<canvasWidth; x++) {
-			insertPixel(frm, coord(loc.x - canvasWidth/2 + x, loc.y - canvasHeight/2 - 1), borderColor);
-			insertPixel(frm, coord(loc.x - canvasWidth/2 + x, loc.y - canvasHeight/2 + canvasHeight), borderColor);
+		if (fds[2].revents && !readKeys(in)) {
+			fds[2].fd = -1; // end of input, e.g. stdin from /dev/null
 		}
 	}
 }
 
-int rotasiX(int xAwal,int yAwal,Coord loc,int sudut){
-	return ((xAwal-loc.x)*cos(sudut)-(yAwal-loc.y)*sin(sudut)+loc.x);
+// open the mouse and put the terminal in raw mode, both optional; 0 on success
+int startInput(Input* in, const char* mousePath, int width, int height) {
+	in->queue.head.store(0);
+	in->queue.tail.store(0);
+	in->width = width;
+	in->height = height;
+	in->mouse = coord(width*mouseSensitivity/2, height*mouseSensitivity/2);
+	in->buttons = 0;
+	in->mouseFd = open(mousePath, O_RDONLY | O_NONBLOCK);
+	if (pipe(in->wake)) {
+		if (in->mouseFd >= 0) close(in->mouseFd);
+		return 1;
+	}
+	
+	// keys arrive one by one, unechoed, and ctrl-c comes as a key to quit with.
+	// A background job leaves the terminal alone: touching it would stop us
+	// with SIGTTOU or SIGTTIN.
+	in->keysFd = STDIN_FILENO;
+	in->rawTerminal = 0;
+	if (isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) != getpgrp()) {
+		in->keysFd = -1;
+	} else if (isatty(STDIN_FILENO) && !tcgetattr(STDIN_FILENO, &in->savedTerminal)) {
+		struct termios raw = in->savedTerminal;
+		raw.c_lflag &= ~(ICANON | ECHO | ISIG);
+		raw.c_cc[VMIN] = 1;
+		raw.c_cc[VTIME] = 0;
+		in->rawTerminal = !tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+	}
+	
+	in->worker = thread(inputWorker, in);
+	return 0;
 }
 
-int rotasiY(int xAwal,int yAwal,Coord loc,int sudut){
-	return ((xAwal-loc.x)*sin(sudut)+(yAwal-loc.y)*cos(sudut)+loc.y);
+void stopInput(Input* in) {
+	char stop = 0;
+	if (write(in->wake[1], &stop, 1) < 0) {
+		perror("Error: cannot stop the input thread");
+	}
+	in->worker.join();
+	if (in->rawTerminal) {
+		tcsetattr(STDIN_FILENO, TCSANOW, &in->savedTerminal);
+	}
+	close(in->wake[0]);
+	close(in->wake[1]);
+	if (in->mouseFd >= 0) {
+		close(in->mouseFd);
+	}
 }
 
-void plotCircle(Frame* frm,int xm, int ym, int r,RGB col)
-{
-   int x = -r, y = 0, err = 2-2*r; /* II. Quadrant */ 
-   do {
-      insertPixel(frm,coord(xm-x, ym+y),col); /*   I. Quadrant */
-      insertPixel(frm,coord(xm-y, ym-x),col); /*  II. Quadrant */
-      insertPixel(frm,coord(xm+x, ym-y),col); /* III. Quadrant */
-      insertPixel(frm,coord(xm+y, ym+x),col); /*  IV. Quadrant */
-      r = err;
-      if (r <= y) err += ++y*2+1;           /* e_xy+e_y < 0 */
-      if (r > x || err > y) err += ++x*2+1; /* e_xy+e_x > 0 or no 2nd y-step */
-   } while (x < 0);
-}
+/* PROFILING ----------------------------------------------------------- */
+// Each frame is split into stages timed by scoped timers. A nested scope pauses
+// the one around it, so every stage gets its own time only. Finished frames go
+// into a ring that only the main loop writes.
 
-void plotHalfCircle(Frame *frm,int xm, int ym, int r,RGB col)
-{
-   int x = -r, y = 0, err = 2-2*r; /* II. Quadrant */ 
-   do {
-      insertPixel(frm,coord(xm+x, ym-y),col); /* III. Quadrant */
-      insertPixel(frm,coord(xm+y, ym+x),col); /*  IV. Quadrant */
-      r = err;
-      if (r <= y) err += ++y*2+1;           /* e_xy+e_y < 0 */
-      if (r > x || err > y) err += ++x*2+1; /* e_xy+e_x > 0 or no 2nd y-step */
-   } while (x < 0);
+//Timed stages of a frame
+enum {
+	stageTick, // the simulation, without collision
+	stageCollide,
+	stageCompose, // changed canvas regions onto the screen
+	stageFlush,
+	stageDraw, // draw calls, recorded when rendering in parallel
+	stageRaster,
+	stageShow,
+	stageHud,
+	stageCount
+};
+
+static const char* stageNames[stageCount] = {"tick", "collide", "compose", "flush", "draw", "raster", "show", "hud"};
+
+//Timings of one frame
+typedef struct s_frameProfile {
+	int frame;
+	float ms[stageCount];
+	float total; // the whole frame, without the wait of a frame rate cap
+	long long pixels; // written by every thread
+} FrameProfile;
+
+//Profiled frames, the newest profileFrames of them. The slot is written before
+//head moves past it, so readers on other threads only ever see whole frames.
+typedef struct s_profiler {
+	FrameProfile ring[profileFrames];
+	atomic<unsigned int> head; // frames finished in all
+	FrameProfile cur;
+	int stage; // whose time is running, -1 for none
+	double since; // when it last started running
+	double frameStart;
+} Profiler;
+
+// the profiler the timers report to, NULL when profiling is off
+static Profiler* profiler = NULL;
+
+double nowSeconds() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
 }
 
-/* Fungsi membuat garis */
-void plotLine(Frame* frm, int x0, int y0, int x1, int y1, RGB lineColor)
-{
-	int dx =  abs(x1-x0), sx = x0<x1 ? 1 : -1;
-	int dy = -abs(y1-y0), sy = y0<y1 ? 1 : -1; 
-	int err = dx+dy, e2; /* error value e_xy */
-	int loop = 1;
-	while(loop){  /* loop */
-		insertPixel(frm, coord(x0, y0), rgb(lineColor.r, lineColor.g, lineColor.b));
-		if (x0==x1 && y0==y1) loop = 0;
-		e2 = 2*err;
-		if (e2 >= dy) { err += dy; x0 += sx; } /* e_xy+e_x > 0 */
-		if (e2 <= dx) { err += dx; y0 += sy; } /* e_xy+e_y < 0 */
+// stop the running stage's clock and start stage's, returning the one that ran
+int switchStage(Profiler* prof, int stage) {
+	double now = nowSeconds();
+	int prev = prof->stage;
+	if (prev >= 0) {
+		prof->cur.ms[prev] += (now - prof->since) * 1e3;
 	}
+	prof->stage = stage;
+	prof->since = now;
+	return prev;
 }
 
-void plotLineWidth(Frame* frm, int x0, int y0, int x1, int y1, float wd, RGB lineColor) { 
-	int dx = abs(x1-x0), sx = x0 < x1 ? 1 : -1; 
-	int dy = abs(y1-y0), sy = y0 < y1 ? 1 : -1; 
-	int err = dx-dy, e2, x2, y2;                          /* error value e_xy */
+// from now on the time goes to stage
+void profileStage(int stage) {
+	if (profiler) switchStage(profiler, stage);
+}
 
-	float ed = dx+dy == 0 ? 1 : sqrt((float)dx*dx+(float)dy*dy);
+//Times a stage nested in another one until it goes out of scope
+struct ProfileScope {
+	int outer;
+	ProfileScope(int stage) {
+		outer = profiler ? switchStage(profiler, stage) : -1;
+	}
+	~ProfileScope() {
+		if (profiler) switchStage(profiler, outer);
+	}
+};
 
-	for (wd = (wd+1)/2; ; ) {                                   /* pixel loop */
-		insertPixel(frm, coord(x0, y0), rgb(max(0,lineColor.r*(abs(err-dx+dy)/ed-wd+1)), 
-											max(0,lineColor.g*(abs(err-dx+dy)/ed-wd+1)), 
-											max(0,lineColor.b*(abs(err-dx+dy)/ed-wd+1))));
+void initProfiler(Profiler* prof) {
+	prof->head = 0;
+	prof->stage = -1;
+	memset(&prof->cur, 0, sizeof(prof->cur));
+}
 
-		e2 = err; x2 = x0;
-		if (2*e2 >= -dx) {                                           /* x step */
-			for (e2 += dy, y2 = y0; e2 < ed*wd && (y1 != y2 || dx > dy); e2 += dx)
-				y2 += sy;
-				insertPixel(frm, coord(x0, y2), rgb(max(0,lineColor.r*(abs(e2)/ed-wd+1)), 
-															max(0,lineColor.g*(abs(e2)/ed-wd+1)), 
-															max(0,lineColor.b*(abs(e2)/ed-wd+1)))); 
-			if (x0 == x1) break;
-			e2 = err; err -= dy; x0 += sx; 
-		} 
-		
-		if (2*e2 <= dy) {                                            /* y step */
-			for (e2 = dx-e2; e2 < ed*wd && (x1 != x2 || dx < dy); e2 += dy)
-				x2 += sx;
-				insertPixel(frm, coord(x2, y0), rgb(max(0,lineColor.r*(abs(e2)/ed-wd+1)), 
-															max(0,lineColor.g*(abs(e2)/ed-wd+1)), 
-															max(0,lineColor.b*(abs(e2)/ed-wd+1)))); 
-			if (y0 == y1) break;
-			err += dx; y0 += sy; 
-		}
+void beginFrameProfile(Profiler* prof) {
+	memset(&prof->cur, 0, sizeof(prof->cur));
+	prof->cur.frame = prof->head;
+	prof->frameStart = nowSeconds();
+}
+
+// finish the frame and publish it to the ring
+void endFrameProfile(Profiler* prof, long long pixels) {
+	unsigned int head = prof->head.load(memory_order_relaxed);
+	switchStage(prof, -1);
+	prof->cur.total = (nowSeconds() - prof->frameStart) * 1e3;
+	prof->cur.pixels = pixels;
+	prof->ring[head % profileFrames] = prof->cur;
+	prof->head.store(head + 1, memory_order_release);
+}
+
+// copy the newest frames, up to limit of them, oldest first. Returns how many.
+int recentFrames(Profiler* prof, FrameProfile* out, int limit) {
+	unsigned int head = prof->head.load(memory_order_acquire);
+	int n = min((unsigned int)limit, min(head, (unsigned int)profileFrames));
+	int i;
+	for (i=0; i<n; i++) {
+		out[i] = prof->ring[(head - n + i) % profileFrames];
 	}
+	return n;
 }
 
-vector<Coord> getBirdCoordinate(Coord center) {
-	vector<Coord> birdCoord;
+// the q-th quantile (0..1) of n frame times, reordering them
+float frameTimeQuantile(float* ms, int n, float q) {
+	if (n == 0) return 0;
+	int k = min(n - 1, (int)(q * n));
+	nth_element(ms, ms + k, ms + n);
+	return ms[k];
+}
 
-	birdCoord.push_back(coord(center.x, center.y));
-	birdCoord.push_back(coord(birdCoord.at(0).x+10, birdCoord.at(0).y-5));
-	birdCoord.push_back(coord(birdCoord.at(1).x+13, birdCoord.at(1).y+7));
-	birdCoord.push_back(coord(birdCoord.at(2).x-10, birdCoord.at(2).y+5));
-	birdCoord.push_back(coord(birdCoord.at(3).x-10, birdCoord.at(3).y-5));
+/* DAMAGE TRACKING ----------------------------------------------------- */
 
-	return birdCoord;
+// construct rect
+Rect rect(int x0, int y0, int x1, int y1) {
+	Rect retval;
+	retval.x0 = x0;
+	retval.y0 = y0;
+	retval.x1 = x1;
+	retval.y1 = y1;
+	return retval;
 }
 
-/* FUNCTIONS FOR SCANLINE ALGORITHM ---------------------------------------------------- */
+int rectArea(Rect r) {
+	return (r.x1 - r.x0) * (r.y1 - r.y0);
+}
 
-bool isSlopeEqualsZero(int y0, int y1){
-	if(y0 == y1){
-		return true;
-	}else{
-		return false;
+Rect rectUnion(Rect a, Rect b) {
+	return rect(min(a.x0, b.x0), min(a.y0, b.y0), max(a.x1, b.x1), max(a.y1, b.y1));
+}
+
+Rect rectClip(Rect r, int width, int height) {
+	return rect(max(r.x0, 0), max(r.y0, 0), min(r.x1, width), min(r.y1, height));
+}
+
+// add r to a rect list, merging it with any rect it touches.
+// Nearby rects are merged as long as the union doesn't waste much area, and a full
+// list absorbs r into whichever rect grows the least.
+void addDirtyRect(Rect* list, int* count, Rect r) {
+	if (r.x1 <= r.x0 || r.y1 <= r.y0) return;
+	int merged = 1;
+	while (merged) {
+		merged = 0;
+		int i;
+		for (i=0; i<*count; i++) {
+			Rect u = rectUnion(list[i], r);
+			if (rectArea(u) <= rectArea(list[i]) + rectArea(r) + 64*64) {
+				// take list[i] out and retry with the grown rect
+				r = u;
+				list[i] = list[--(*count)];
+				merged = 1;
+				break;
+			}
+		}
+	}
+	if (*count < maxDirtyRects) {
+		list[(*count)++] = r;
+		return;
 	}
+	int best = 0;
+	int bestGrowth = -1;
+	int i;
+	for (i=0; i<*count; i++) {
+		int growth = rectArea(rectUnion(list[i], r)) - rectArea(list[i]);
+		if (bestGrowth < 0 || growth < bestGrowth) {
+			bestGrowth = growth;
+			best = i;
+		}
+	}
+	list[best] = rectUnion(list[best], r);
 }
 
-bool isInBetween(int y0, int y1, int yTest){
-	if((yTest >= y0 && yTest <= y1 || yTest >= y1 && yTest <= y0) && !isSlopeEqualsZero(y0, y1)){
-		return true;
-	}else{
-		return false;
+void resetDamage(Damage* dmg) {
+	dmg->curCount = 0;
+	dmg->prevCount = 0;
+}
+
+// record that [x0,x1) x [y0,y1) of frm is being drawn this frame
+void markDirty(Frame* frm, int x0, int y0, int x1, int y1) {
+	if (frm->damage) {
+		Rect r = rect(max(x0, frm->clip.x0), max(y0, frm->clip.y0), min(x1, frm->clip.x1), min(y1, frm->clip.y1));
+		addDirtyRect(frm->damage->cur, &frm->damage->curCount, r);
 	}
 }
 
-/* Function to calculate intersection between line (a,b) and line with slope 0 */
-Coord intersection(Coord a, Coord b, int y){
-	int x;
-	double slope;
-	
-	if(b.x == a.x){
-		x = a.x;
-	}else{
-		slope = (double)(b.y - a.y) / (double)(b.x - a.x);
-		x = round(((double)(y - a.y) / slope) + (double)a.x);
+// everything that differs between the last two drawn frames: cur plus prev
+int collectDamage(Damage* dmg, Rect* out) {
+	int count = 0;
+	int i;
+	for (i=0; i<dmg->curCount; i++) {
+		addDirtyRect(out, &count, dmg->cur[i]);
 	}
-	
-	return coord(x, y);
+	for (i=0; i<dmg->prevCount; i++) {
+		addDirtyRect(out, &count, dmg->prev[i]);
+	}
+	return count;
 }
 
-bool compareByAxis(const s_coord &a, const s_coord &b){
-	return a.x <= b.x;
+/* DRAW COMMANDS ------------------------------------------------------- */
+
+// append a command for frm's renderer to run later.
+// Returns NULL when the command can't touch the frame's clip, so it is culled.
+DrawCmd* recordCmd(Frame* frm, int type, Rect box, RGB color) {
+	Renderer* rdr = frm->renderer;
+	box = rect(max(box.x0, frm->clip.x0), max(box.y0, frm->clip.y0), min(box.x1, frm->clip.x1), min(box.y1, frm->clip.y1));
+	if (box.x1 <= box.x0 || box.y1 <= box.y0) return NULL;
+	DrawCmd cmd;
+	cmd.type = type;
+	cmd.box = box;
+	cmd.color = color;
+	rdr->cmds.push_back(cmd);
+	return &rdr->cmds.back();
 }
 
-bool compareSameAxis(const s_coord &a, const s_coord &b){
-	return a.x == b.x;
+/* VIDEO OPERATIONS ---------------------------------------------------- */
+
+// construct RGB
+RGB rgb(unsigned char r, unsigned char g, unsigned char b) {
+	RGB retval;
+	retval.r = r;
+	retval.g = g;
+	retval.b = b;
+	return retval;
 }
 
-bool operator==(const Coord& lhs, const Coord& rhs) {
-	if(lhs.x==rhs.x && lhs.y==rhs.y)
-		return true;
-	return false;
+// pack RGB into a framebuffer-ordered pixel (opaque)
+Pixel pixel(RGB col) {
+	return (Pixel)col.b | ((Pixel)col.g << 8) | ((Pixel)col.r << 16) | ((Pixel)255 << 24);
 }
 
-bool isLocalMaxima(const Coord& a, const Coord& b, const Coord& titikPotong) {
-	return ((titikPotong.y<a.y && titikPotong.y<b.y) || (titikPotong.y>a.y && titikPotong.y>b.y));
+// bytes of pixels a width x height frame needs, rows padded to 64 bytes
+size_t frameBytes(int width, int height) {
+	return (size_t)((width + 15) & ~15) * height * sizeof(Pixel);
 }
 
-vector<Coord> intersectionGenerator(int y, vector<Coord> polygon){
-	vector<Coord> intersectionPoint;
-	Coord prevTipot = coord(-9999,-9999);
-	for(int i = 0; i < polygon.size(); i++){
-		if(i == polygon.size() - 1){
-			if(isInBetween(polygon.at(i).y, polygon.at(0).y, y)){				
-				Coord a = coord(polygon.at(i).x, polygon.at(i).y);
-				Coord b = coord(polygon.at(0).x, polygon.at(0).y);
-						
-				Coord titikPotong = intersection(a, b, y);
+// a width x height frame clipped to its own bounds, without pixels yet
+void initFrame(Frame* frm, int width, int height) {
+	frm->px = NULL;
+	frm->width = width;
+	frm->height = height;
+	frm->stride = (width + 15) & ~15;
+	frm->clip = rect(0, 0, width, height);
+	frm->damage = NULL;
+	frm->renderer = NULL;
+	frm->arena = NULL;
+}
 
-				if(titikPotong==b){
-					if(isLocalMaxima(polygon.at(i), polygon.at(1), titikPotong))
-						intersectionPoint.push_back(titikPotong);
-				}
-				else {
-					if(prevTipot==titikPotong){
-						if(isLocalMaxima(polygon.at(i-1), polygon.at(0), titikPotong))
-							intersectionPoint.push_back(titikPotong);
-					}
-					else
-						intersectionPoint.push_back(titikPotong);
-				}
-			}
-		}else{
-			if(isInBetween(polygon.at(i).y, polygon.at(i + 1).y, y)){
-				Coord a = coord(polygon.at(i).x, polygon.at(i).y);
-				Coord b = coord(polygon.at(i + 1).x, polygon.at(i + 1).y);
-				
-				Coord titikPotong = intersection(a, b, y);
-
-				// Jika sama dgn tipot sebelumnya, cek apakah local minima/maxima
-				if(titikPotong==prevTipot) {
-					Coord z = coord(polygon.at(i-1).x, polygon.at(i-1).y);
-					if(isLocalMaxima(z, b, titikPotong)) {
-						intersectionPoint.push_back(titikPotong);
-					}
-				}
-				else {
-					intersectionPoint.push_back(titikPotong);
-				}
-				prevTipot = intersectionPoint.back();
-			}
-		}
+// allocate a width x height frame clipped to its own bounds. Returns 0 on success.
+int createFrame(Frame* frm, int width, int height) {
+	void* mem;
+	initFrame(frm, width, height);
+	if (posix_memalign(&mem, 64, frameBytes(width, height))) {
+		return 1;
 	}
-	
-	sort(intersectionPoint.begin(), intersectionPoint.end(), compareByAxis);
-	
-	return intersectionPoint;
+	frm->px = (Pixel*)mem;
+	return 0;
 }
-vector<Coord> combineIntersection(vector<Coord> a, vector<Coord> b){
-	for(int i = 0; i < b.size(); i++){
-		a.push_back(b.at(i));
+
+void destroyFrame(Frame* frm) {
+	if (!frm->arena) {
+		free(frm->px);
 	}
-	
-	sort(a.begin(), a.end(), compareByAxis);
-	
-	return a;
+	frm->px = NULL;
 }
 
-void fillShape(Frame *frame, int xOffset, int yOffset, int startY, int shapeHeight, std::vector<Coord> shapeCoord, RGB color) {
-	for(int i = startY; i <= shapeHeight; i++){
-		vector<Coord> shapeIntersectionPoint = intersectionGenerator(i, shapeCoord);	
-		for(int j = 0; j < shapeIntersectionPoint.size() - 1; j++){
-			if(j % 2 == 0){
-				int x0 = shapeIntersectionPoint.at(j).x + xOffset;
-				int y0 = shapeIntersectionPoint.at(j).y + yOffset;
-				int x1 = shapeIntersectionPoint.at(j + 1).x + xOffset;
-				int y1 = shapeIntersectionPoint.at(j + 1).y + yOffset;
-				
-				plotLine(frame, x0, y0, x1, y1, color);
-			}
-		}		
+/* SURFACE ARENA ------------------------------------------------------- */
+// The frames drawn into every frame share one mapping on huge pages, so the
+// full-screen clear, compose and present passes need few TLB entries. Without
+// hugetlbfs pages we ask for transparent huge pages, and live with small ones
+// when those are off too.
+
+// map at least size bytes. Returns 0 on success.
+int createArena(Arena* a, size_t size) {
+	a->size = (size + hugePageSize - 1) & ~(size_t)(hugePageSize - 1);
+	a->used = 0;
+	a->pages = "hugetlb";
+	a->base = (char*)mmap(NULL, a->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (a->base != MAP_FAILED) return 0;
+	
+	// transparent huge pages only cover aligned 2 MB, so map one more and trim
+	char* raw = (char*)mmap(NULL, a->size + hugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED) {
+		a->base = NULL;
+		return 1;
+	}
+	a->base = (char*)(((uintptr_t)raw + hugePageSize - 1) & ~(uintptr_t)(hugePageSize - 1));
+	if (a->base > raw) {
+		munmap(raw, a->base - raw);
 	}
+	munmap(a->base + a->size, raw + hugePageSize - a->base);
+	a->pages = "4k";
+#ifdef MADV_HUGEPAGE
+	if (!madvise(a->base, a->size, MADV_HUGEPAGE)) {
+		a->pages = "thp";
+	}
+#endif
+	return 0;
 }
 
-/* Function to draw ship */
-void drawShip(Frame *frame, Coord center, RGB color)
-{
-	// Ship's attributes
-	int panjangDekBawah = 100;
-	int deltaDekAtasBawah = 60;
-	int height = 40;
-	int jarakKeUjung = panjangDekBawah / 2 + deltaDekAtasBawah / 2;
-	
-	// Ship's relative coordinate to canvas, ship's actuator
-	int xShipCoordinate = center.x - jarakKeUjung;
-	int yShipCoordinate = center.y - height;
-	
-	// Ship's border coordinates
-	vector<Coord>  shipCoordinates;
-	
-	shipCoordinates.push_back(coord(0, 0));
-	shipCoordinates.push_back(coord(0 + jarakKeUjung + jarakKeUjung, 0));
-	shipCoordinates.push_back(coord(panjangDekBawah / 2 + panjangDekBawah / 2 + deltaDekAtasBawah/2, height));
-	shipCoordinates.push_back(coord(deltaDekAtasBawah/2, height));
-		
-	// Draw ship's border relative to canvas
-	for(int i = 0; i < shipCoordinates.size(); i++){
-		int x0, y0, x1, y1;
-		
-		if(i < shipCoordinates.size() - 1){
-			x0 = shipCoordinates.at(i).x + xShipCoordinate;
-			y0 = shipCoordinates.at(i).y + yShipCoordinate;
-			x1 = shipCoordinates.at(i + 1).x + xShipCoordinate;
-			y1 = shipCoordinates.at(i + 1).y + yShipCoordinate;
-		}else{
-			x0 = shipCoordinates.at(shipCoordinates.size() - 1).x + xShipCoordinate;
-			y0 = shipCoordinates.at(shipCoordinates.size() - 1).y + yShipCoordinate;
-			x1 = shipCoordinates.at(0).x + xShipCoordinate;
-			y1 = shipCoordinates.at(0).y + yShipCoordinate;
-		}
-		
-		plotLine(frame, x0, y0, x1, y1, color);
+// the next bytes of the arena, 64-byte aligned; NULL when it is full
+void* arenaAlloc(Arena* a, size_t bytes) {
+	size_t start = (a->used + 63) & ~(size_t)63;
+	if (start + bytes > a->size) return NULL;
+	a->used = start + bytes;
+	return a->base + start;
+}
+
+// like createFrame(), with the pixels carved out of a
+int createArenaFrame(Arena* a, Frame* frm, int width, int height) {
+	initFrame(frm, width, height);
+	frm->px = (Pixel*)arenaAlloc(a, frameBytes(width, height));
+	if (!frm->px) return 1;
+	frm->arena = a;
+	return 0;
+}
+
+// unmap a with every frame carved out of it
+void destroyArena(Arena* a) {
+	if (a->base) {
+		munmap(a->base, a->size);
 	}
-	
-	// Coloring ship using scanline algorithm
-	for(int i = 1; i <= height; i++){
-		vector<Coord> shipIntersectionPoint = intersectionGenerator(i, shipCoordinates);
+	a->base = NULL;
+}
 
-		if(shipIntersectionPoint.size() % 2 != 0){
-			unique(shipIntersectionPoint.begin(), shipIntersectionPoint.end(), compareSameAxis);
-			shipIntersectionPoint.erase(shipIntersectionPoint.end() - 1);
-		}
-		
-		for(int j = 0; j < shipIntersectionPoint.size() - 1; j++){
-			if(j % 2 == 0){
-				int x0 = shipIntersectionPoint.at(j).x + xShipCoordinate;
-				int y0 = shipIntersectionPoint.at(j).y + yShipCoordinate;
-				int x1 = shipIntersectionPoint.at(j + 1).x + xShipCoordinate;
-				int y1 = shipIntersectionPoint.at(j + 1).y + yShipCoordinate;
-				
-				plotLine(frame, x0, y0, x1, y1, color);
-			}
-		}		
-	}	
+// start of row y
+Pixel* frameRow(const Frame* frm, int y) {
+	return frm->px + (long)y * frm->stride;
 }
 
-void drawStickman(Frame* frm,Coord loc,int sel,RGB color,int counter){
-	plotCircle(frm,loc.x,loc.y,15,color);
-	plotLine(frm,loc.x,loc.y+15,loc.x,loc.y+50,color);
+// pixels stored by the raster functions on this thread (for benchmarks)
+static __thread long long pixelsWritten = 0;
+
+// insert pixel to composition frame, with bounds filter
+void insertPixel(Frame* frm, Coord loc, RGB col) {
+	// do bounding check:
+	if (!(loc.x >= frm->clip.x1 || loc.x < frm->clip.x0 || loc.y >= frm->clip.y1 || loc.y < frm->clip.y0)) {
+		frameRow(frm, loc.y)[loc.x] = pixel(col);
+		pixelsWritten++;
+	}
+}
+
+// write n copies of p from dst on, with aligned 64-byte stores in the middle
+void storeRun(Pixel* dst, int n, Pixel p) {
+	int x = 0;
+#ifdef HAVE_X86_SIMD
+	__m128i v = _mm_set1_epi32(p);
+	for (; x<n && ((uintptr_t)(dst + x) & 15); x++) {
+		dst[x] = p;
+	}
+	for (; x+16<=n; x+=16) {
+		_mm_store_si128((__m128i*)(dst + x), v);
+		_mm_store_si128((__m128i*)(dst + x + 4), v);
+		_mm_store_si128((__m128i*)(dst + x + 8), v);
+		_mm_store_si128((__m128i*)(dst + x + 12), v);
+	}
+	for (; x+4<=n; x+=4) {
+		_mm_store_si128((__m128i*)(dst + x), v);
+	}
+#endif
+	for (; x<n; x++) {
+		dst[x] = p;
+	}
+}
+
+// horizontal run [xa, xb] on row y, clipped once
+void hspan(Frame* frm, int y, int xa, int xb, Pixel p) {
+	Rect clip = frm->clip;
+	if (y < clip.y0 || y >= clip.y1) return;
+	xa = max(xa, clip.x0);
+	xb = min(xb, clip.x1 - 1);
+	if (xa > xb) return;
+	pixelsWritten += xb - xa + 1;
+	storeRun(frameRow(frm, y) + xa, xb - xa + 1, p);
+}
+
+// vertical run [ya, yb] on column x, clipped once
+void vspan(Frame* frm, int x, int ya, int yb, Pixel p) {
+	Rect clip = frm->clip;
+	if (x < clip.x0 || x >= clip.x1) return;
+	ya = max(ya, clip.y0);
+	yb = min(yb, clip.y1 - 1);
+	if (ya > yb) return;
+	pixelsWritten += yb - ya + 1;
+	Pixel* dst = frameRow(frm, ya) + x;
+	int y;
+	for (y=ya; y<=yb; y++) {
+		*dst = p;
+		dst += frm->stride;
+	}
+}
+
+// mix p into *dst, cover out of 256 parts
+void blendPixel(Pixel* dst, Pixel p, int cover) {
+	Pixel d = *dst;
+	// red and blue side by side, each product still fits in its 16 bits
+	Pixel rb = (((d & 0xFF00FF) * (256 - cover) + (p & 0xFF00FF) * cover) >> 8) & 0xFF00FF;
+	Pixel g = (((d & 0x00FF00) * (256 - cover) + (p & 0x00FF00) * cover) >> 8) & 0x00FF00;
+	*dst = rb | g | 0xFF000000;
+}
+
+// solid rectangle r, clipped once
+void fillRect(Frame* frm, Rect r, Pixel p) {
+	int y;
+	r = rect(max(r.x0, frm->clip.x0), max(r.y0, frm->clip.y0), min(r.x1, frm->clip.x1), min(r.y1, frm->clip.y1));
+	if (r.x0 >= r.x1 || r.y0 >= r.y1) return;
+	pixelsWritten += rectArea(r);
+	for (y=r.y0; y<r.y1; y++) {
+		storeRun(frameRow(frm, y) + r.x0, r.x1 - r.x0, p);
+	}
+}
+
+// fill r with color, limited to the clip
+void rasterClear(Frame* frm, Rect r, RGB color) {
+	fillRect(frm, r, pixel(color));
+}
+
+// clear r now, or as a command when frm is being recorded
+void clearRect(Frame* frm, Rect r, RGB color) {
+	if (frm->renderer) {
+		recordCmd(frm, cmdClear, r, color);
+		return;
+	}
+	rasterClear(frm, r, color);
+}
+
+// solid rectangle r, marked as drawn
+void plotRect(Frame* frm, Rect r, RGB color) {
+	markDirty(frm, r.x0, r.y0, r.x1, r.y1);
+	clearRect(frm, r, color);
+}
+
+// delete contents of composition frame
+void flushFrame (Frame* frm, RGB color) {
+	clearRect(frm, rect(0, 0, frm->width, frm->height), color);
+	markDirty(frm, 0, 0, frm->width, frm->height);
+}
+
+// delete only what was drawn since the last call, then start a new damage frame
+void flushDamage (Frame* frm, RGB color) {
+	Damage* dmg = frm->damage;
+	int i;
+	for (i=0; i<dmg->curCount; i++) {
+		clearRect(frm, dmg->cur[i], color);
+		dmg->prev[i] = dmg->cur[i];
+	}
+	dmg->prevCount = dmg->curCount;
+	dmg->curCount = 0;
+}
+
+// copy the part r (canvas space) of the canvas centered at loc into the frame
+void showCanvasRect(Frame* frm, Frame* cnvs, Coord loc, Rect r) {
+	int y;
+	int x0 = loc.x - cnvs->width/2;
+	int y0 = loc.y - cnvs->height/2;
+	
+	// clip against the canvas and the frame once, then copy whole rows
+	int sx = max(max(0, frm->clip.x0 - x0), r.x0);
+	int sy = max(max(0, frm->clip.y0 - y0), r.y0);
+	int ex = min(min(cnvs->width, frm->clip.x1 - x0), r.x1);
+	int ey = min(min(cnvs->height, frm->clip.y1 - y0), r.y1);
+	if (ex > sx) {
+		pixelsWritten += (long long)max(0, ey - sy) * (ex - sx);
+		for (y=sy; y<ey; y++) {
+			memcpy(frameRow(frm, y0 + y) + x0 + sx, frameRow(cnvs, y) + sx, (ex - sx) * sizeof(Pixel));
+		}
+	}
+}
+
+void showCanvas(Frame* frm, Frame* cnvs, Coord loc, RGB borderColor, int isBorder) {
+	int x0 = loc.x - cnvs->width/2;
+	int y0 = loc.y - cnvs->height/2;
+	showCanvasRect(frm, cnvs, loc, rect(0, 0, cnvs->width, cnvs->height));
+	
+	//show border
+	if(isBorder){
+		rasterClear(frm, rect(x0 - 1, y0, x0, y0 + cnvs->height), borderColor);
+		rasterClear(frm, rect(x0 + cnvs->width, y0, x0 + cnvs->width + 1, y0 + cnvs->height), borderColor);
+		rasterClear(frm, rect(x0, y0 - 1, x0 + cnvs->width, y0), borderColor);
+		rasterClear(frm, rect(x0, y0 + cnvs->height, x0 + cnvs->width, y0 + cnvs->height + 1), borderColor);
+	}
+}
+
+/* PRESENT KERNELS ----------------------------------------------------- */
+
+// an 8-bit channel value widened or narrowed to len bits, high bits repeated into the low ones
+uint32_t scaleChannel(uint32_t v, int len) {
+	if (len <= 8) return v >> (8 - len);
+	uint32_t out = 0;
+	int shift = len - 8;
+	for (; shift > -8; shift -= 8) {
+		out |= shift >= 0 ? v << shift : v >> -shift;
+	}
+	return out;
+}
+
+// any channel layout, one pixel at a time
+void presentRowGeneric(const FrameBuffer* fb, char* dst, const Pixel* src, int n) {
+	int bytes = fb->bpp/8;
+	int x, i;
+	for (x=0; x<n; x++) {
+		Pixel p = src[x];
+		uint32_t out = (scaleChannel((p >> 16) & 255, fb->redLength) << fb->redOffset)
+			| (scaleChannel((p >> 8) & 255, fb->greenLength) << fb->greenOffset)
+			| (scaleChannel(p & 255, fb->blueLength) << fb->blueOffset)
+			| (scaleChannel(255, fb->transpLength) << fb->transpOffset); // opaque
+		for (i=0; i<bytes; i++) {
+			dst[x*bytes + i] = (out >> (8*i)) & 255;
+		}
+	}
+}
+
+// 32bpp BGRA: our pixels already have the right layout
+void presentRowBGRA32(char* dst, const Pixel* src, int n) {
+	memcpy(dst, src, n * sizeof(Pixel));
+}
+
+// 24bpp BGR: overlapping 4-byte stores, the last pixel is written bytewise
+void presentRowBGR24(char* dst, const Pixel* src, int n) {
+	int x;
+	for (x=0; x<n-1; x++) {
+		memcpy(dst + x*3, &src[x], 4);
+	}
+	if (n > 0) {
+		memcpy(dst + (n-1)*3, &src[n-1], 3);
+	}
+}
+
+// 16bpp RGB565
+void presentRowRGB565(char* dst, const Pixel* src, int n) {
+	uint16_t* out = (uint16_t*)dst;
+	int x;
+	for (x=0; x<n; x++) {
+		Pixel p = src[x];
+		out[x] = ((p >> 8) & 0xF800) | ((p >> 5) & 0x07E0) | ((p >> 3) & 0x001F);
+	}
+}
+
+#ifdef HAVE_X86_SIMD
+// 32bpp BGRA with non-temporal stores, so whole cache lines go straight to video memory
+void presentRowBGRA32_SSE2(char* dst, const Pixel* src, int n) {
+	int x = 0;
+	for (; x<n && ((uintptr_t)(dst + x*4) & 15); x++) {
+		((Pixel*)dst)[x] = src[x];
+	}
+	for (; x+16<=n; x+=16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(src + x));
+		__m128i b = _mm_loadu_si128((const __m128i*)(src + x + 4));
+		__m128i c = _mm_loadu_si128((const __m128i*)(src + x + 8));
+		__m128i d = _mm_loadu_si128((const __m128i*)(src + x + 12));
+		_mm_stream_si128((__m128i*)(dst + x*4), a);
+		_mm_stream_si128((__m128i*)(dst + x*4 + 16), b);
+		_mm_stream_si128((__m128i*)(dst + x*4 + 32), c);
+		_mm_stream_si128((__m128i*)(dst + x*4 + 48), d);
+	}
+	for (; x<n; x++) {
+		((Pixel*)dst)[x] = src[x];
+	}
+}
+
+__attribute__((target("avx2")))
+void presentRowBGRA32_AVX2(char* dst, const Pixel* src, int n) {
+	int x = 0;
+	for (; x<n && ((uintptr_t)(dst + x*4) & 31); x++) {
+		((Pixel*)dst)[x] = src[x];
+	}
+	for (; x+16<=n; x+=16) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)(src + x));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(src + x + 8));
+		_mm256_stream_si256((__m256i*)(dst + x*4), a);
+		_mm256_stream_si256((__m256i*)(dst + x*4 + 32), b);
+	}
+	for (; x<n; x++) {
+		((Pixel*)dst)[x] = src[x];
+	}
+}
+
+// 24bpp BGR: 16 pixels (64 bytes) in, 48 bytes out per iteration
+__attribute__((target("ssse3")))
+void presentRowBGR24_SSSE3(char* dst, const Pixel* src, int n) {
+	// drop every 4th byte, leaving 12 packed bytes in the low part of the register
+	const __m128i pack = _mm_setr_epi8(0,1,2, 4,5,6, 8,9,10, 12,13,14, -1,-1,-1,-1);
+	int x = 0;
+	for (; x+16<=n; x+=16) {
+		__m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + x)), pack);
+		__m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + x + 4)), pack);
+		__m128i c = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + x + 8)), pack);
+		__m128i d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + x + 12)), pack);
+		// a(12) b(4) | b(8) c(8) | c(4) d(12)
+		__m128i o0 = _mm_or_si128(a, _mm_slli_si128(b, 12));
+		__m128i o1 = _mm_or_si128(_mm_srli_si128(b, 4), _mm_slli_si128(c, 8));
+		__m128i o2 = _mm_or_si128(_mm_srli_si128(c, 8), _mm_slli_si128(d, 4));
+		_mm_storeu_si128((__m128i*)(dst + x*3), o0);
+		_mm_storeu_si128((__m128i*)(dst + x*3 + 16), o1);
+		_mm_storeu_si128((__m128i*)(dst + x*3 + 32), o2);
+	}
+	presentRowBGR24(dst + x*3, src + x, n - x);
+}
+
+// 16bpp RGB565, 8 pixels per iteration
+void presentRowRGB565_SSE2(char* dst, const Pixel* src, int n) {
+	const __m128i maskR = _mm_set1_epi32(0xF800);
+	const __m128i maskG = _mm_set1_epi32(0x07E0);
+	const __m128i maskB = _mm_set1_epi32(0x001F);
+	int x = 0;
+	for (; x+8<=n; x+=8) {
+		__m128i p0 = _mm_loadu_si128((const __m128i*)(src + x));
+		__m128i p1 = _mm_loadu_si128((const __m128i*)(src + x + 4));
+		__m128i v0 = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p0, 8), maskR),
+			_mm_and_si128(_mm_srli_epi32(p0, 5), maskG)), _mm_and_si128(_mm_srli_epi32(p0, 3), maskB));
+		__m128i v1 = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p1, 8), maskR),
+			_mm_and_si128(_mm_srli_epi32(p1, 5), maskG)), _mm_and_si128(_mm_srli_epi32(p1, 3), maskB));
+		// sign-extend the low halves so the saturating pack keeps all 16 bits
+		v0 = _mm_srai_epi32(_mm_slli_epi32(v0, 16), 16);
+		v1 = _mm_srai_epi32(_mm_slli_epi32(v1, 16), 16);
+		_mm_storeu_si128((__m128i*)(dst + x*2), _mm_packs_epi32(v0, v1));
+	}
+	presentRowRGB565(dst + x*2, src + x, n - x);
+}
+
+__attribute__((target("avx2")))
+void presentRowRGB565_AVX2(char* dst, const Pixel* src, int n) {
+	const __m256i maskR = _mm256_set1_epi32(0xF800);
+	const __m256i maskG = _mm256_set1_epi32(0x07E0);
+	const __m256i maskB = _mm256_set1_epi32(0x001F);
+	int x = 0;
+	for (; x+16<=n; x+=16) {
+		__m256i p0 = _mm256_loadu_si256((const __m256i*)(src + x));
+		__m256i p1 = _mm256_loadu_si256((const __m256i*)(src + x + 8));
+		__m256i v0 = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(p0, 8), maskR),
+			_mm256_and_si256(_mm256_srli_epi32(p0, 5), maskG)), _mm256_and_si256(_mm256_srli_epi32(p0, 3), maskB));
+		__m256i v1 = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(p1, 8), maskR),
+			_mm256_and_si256(_mm256_srli_epi32(p1, 5), maskG)), _mm256_and_si256(_mm256_srli_epi32(p1, 3), maskB));
+		// packus works per 128-bit lane, so put the quadwords back in order afterwards
+		__m256i packed = _mm256_packus_epi32(v0, v1);
+		_mm256_storeu_si256((__m256i*)(dst + x*2), _mm256_permute4x64_epi64(packed, 0xD8));
+	}
+	presentRowRGB565(dst + x*2, src + x, n - x);
+}
+#endif
+
+// pick the fastest row converter for this framebuffer's pixel format
+void choosePresentKernel(FrameBuffer* fb, struct fb_var_screeninfo* vInfo) {
+	fb->redOffset = vInfo->red.offset;
+	fb->redLength = vInfo->red.length;
+	fb->greenOffset = vInfo->green.offset;
+	fb->greenLength = vInfo->green.length;
+	fb->blueOffset = vInfo->blue.offset;
+	fb->blueLength = vInfo->blue.length;
+	fb->transpOffset = vInfo->transp.offset;
+	fb->transpLength = vInfo->transp.length;
+	
+	int isBGR = fb->redOffset == 16 && fb->greenOffset == 8 && fb->blueOffset == 0
+		&& fb->redLength == 8 && fb->greenLength == 8 && fb->blueLength == 8;
+	int is565 = fb->redOffset == 11 && fb->greenOffset == 5 && fb->blueOffset == 0
+		&& fb->redLength == 5 && fb->greenLength == 6 && fb->blueLength == 5;
+	
+	fb->presentRow = NULL;
+	fb->presentName = "generic";
+	if (fb->bpp == 32 && isBGR) {
+		fb->presentRow = presentRowBGRA32;
+		fb->presentName = "bgra32";
+#ifdef HAVE_X86_SIMD
+		fb->presentRow = presentRowBGRA32_SSE2;
+		fb->presentName = "bgra32-sse2";
+		if (__builtin_cpu_supports("avx2")) {
+			fb->presentRow = presentRowBGRA32_AVX2;
+			fb->presentName = "bgra32-avx2";
+		}
+#endif
+	} else if (fb->bpp == 24 && isBGR) {
+		fb->presentRow = presentRowBGR24;
+		fb->presentName = "bgr24";
+#ifdef HAVE_X86_SIMD
+		if (__builtin_cpu_supports("ssse3")) {
+			fb->presentRow = presentRowBGR24_SSSE3;
+			fb->presentName = "bgr24-ssse3";
+		}
+#endif
+	} else if (fb->bpp == 16 && is565) {
+		fb->presentRow = presentRowRGB565;
+		fb->presentName = "rgb565";
+#ifdef HAVE_X86_SIMD
+		fb->presentRow = presentRowRGB565_SSE2;
+		fb->presentName = "rgb565-sse2";
+		if (__builtin_cpu_supports("avx2")) {
+			fb->presentRow = presentRowRGB565_AVX2;
+			fb->presentName = "rgb565-avx2";
+		}
+#endif
+	}
+}
+
+// the whole buffer as is
+void writeFrameRaw(FrameBuffer* fb) {
+	fwrite(fb->base, fb->smemLen, 1, fb->sink);
+}
+
+// RGB rows
+void writeFramePPM(FrameBuffer* fb) {
+	int x, y;
+	fprintf(fb->sink, "P6\n%d %d\n255\n", fb->width, fb->height);
+	for (y=0; y<fb->height; y++) {
+		const Pixel* row = (const Pixel*)(fb->base + y * fb->lineLen);
+		for (x=0; x<fb->width; x++) {
+			fb->sinkRow[x*3    ] = (row[x] >> 16) & 255; // red
+			fb->sinkRow[x*3 + 1] = (row[x] >> 8) & 255;  // green
+			fb->sinkRow[x*3 + 2] = row[x] & 255;         // blue
+		}
+		fwrite(fb->sinkRow, fb->width * 3, 1, fb->sink);
+	}
+}
+
+// pick the frame writer for a file output
+void chooseSinkKernel(FrameBuffer* fb) {
+	fb->writeFrame = NULL;
+	if (fb->output == outputRaw) {
+		fb->writeFrame = writeFrameRaw;
+	} else if (fb->output == outputPPM) {
+		fb->writeFrame = writeFramePPM;
+	}
+}
+
+// convert the part r of frm into the FrameBuffer page being drawn, with r's corner at (dx,dy)
+void presentFrameRect (Frame* frm, FrameBuffer* fb, Rect r, int dx, int dy) {
+	int y;
+	int bytes = fb->bpp/8;
+	
+	// clip against the source frame and the screen
+	r = rectClip(r, frm->width, frm->height);
+	dx -= r.x0;
+	dy -= r.y0;
+	r = rectClip(rect(r.x0 + dx, r.y0 + dy, r.x1 + dx, r.y1 + dy), fb->width, fb->height);
+	if (r.x1 <= r.x0 || r.y1 <= r.y0) return;
+	pixelsWritten += rectArea(r);
+	for (y=r.y0; y<r.y1; y++) {
+		char* dst = fb->ptr + y * fb->lineLen + r.x0 * bytes;
+		const Pixel* src = frameRow(frm, y - dy) + r.x0 - dx;
+		if (fb->presentRow) {
+			fb->presentRow(dst, src, r.x1 - r.x0);
+		} else {
+			presentRowGeneric(fb, dst, src, r.x1 - r.x0);
+		}
+	}
+#ifdef HAVE_X86_SIMD
+	// make the streamed rows visible before the next frame starts
+	_mm_sfence();
+#endif
+}
+
+// copy the part r of the composition Frame to FrameBuffer
+void showFrameRect (Frame* frm, FrameBuffer* fb, Rect r) {
+	presentFrameRect(frm, fb, r, r.x0, r.y0);
+}
+
+// copy composition Frame to FrameBuffer
+void showFrame (Frame* frm, FrameBuffer* fb) {
+	showFrameRect(frm, fb, rect(0, 0, frm->width, frm->height));
+}
+
+/* PAGE FLIPPING ------------------------------------------------------- */
+
+// ask for a virtual screen two pages tall and check that the driver can pan over it.
+// Must run before the framebuffer is mapped, since it can change smem_len and line_length.
+void setupPageFlip(FrameBuffer* fb, int fbFile, struct fb_var_screeninfo* vInfo, int wantFlip) {
+	struct fb_var_screeninfo flip = *vInfo;
+	struct fb_fix_screeninfo fix;
+	fb->fd = fbFile;
+	fb->var = *vInfo;
+	fb->savedVar = *vInfo;
+	fb->pageCount = 1;
+	fb->backPage = 0;
+	fb->pendingCount[0] = fb->pendingCount[1] = 0;
+	if (!wantFlip) return;
+	
+	flip.yres_virtual = vInfo->yres * 2;
+	flip.yoffset = 0;
+	if (ioctl(fbFile, FBIOPUT_VSCREENINFO, &flip)) {
+		return; // mode unchanged
+	}
+	// from here on every way out without flipping puts the original mode back
+	if (ioctl(fbFile, FBIOGET_VSCREENINFO, &flip) || ioctl(fbFile, FBIOGET_FSCREENINFO, &fix)
+		|| flip.yres_virtual < vInfo->yres * 2 || fix.ypanstep == 0
+		|| fix.smem_len < fix.line_length * vInfo->yres * 2
+		|| ioctl(fbFile, FBIOPAN_DISPLAY, &flip)) {
+		ioctl(fbFile, FBIOPUT_VSCREENINFO, vInfo);
+		return;
+	}
+	fb->var = flip;
+	fb->pageCount = 2;
+	fb->backPage = 1;
+}
+
+// put back the mode setupPageFlip() found, if it changed it. flipPage() can drop
+// to one page without touching the mode, so look at the mode and not at pageCount.
+void undoPageFlip(FrameBuffer* fb) {
+	if (fb->var.yres_virtual != fb->savedVar.yres_virtual) {
+		ioctl(fb->fd, FBIOPUT_VSCREENINFO, &fb->savedVar);
+	}
+	fb->var = fb->savedVar;
+	fb->pageCount = 1;
+	fb->backPage = 0;
+}
+
+// point fb->ptr at the page to draw into; call after mapping
+void selectBackPage(FrameBuffer* fb) {
+	fb->ptr = fb->base + fb->backPage * fb->var.yres * fb->lineLen;
+}
+
+// remember damage for every page, each catches up on it when it is next drawn
+void queuePageDamage(FrameBuffer* fb, Rect* rects, int count) {
+	int p, i;
+	for (p=0; p<fb->pageCount; p++) {
+		for (i=0; i<count; i++) {
+			addDirtyRect(fb->pending[p], &fb->pendingCount[p], rects[i]);
+		}
+	}
+}
+
+// show the page just drawn and start drawing into the other one. Returns 1 when
+// the driver stopped panning: page 0 is then stale and the caller must redraw it whole.
+int flipPage(FrameBuffer* fb) {
+	if (fb->pageCount < 2) return 0;
+	if (fb->vsync) {
+		int arg = 0;
+		if (ioctl(fb->fd, FBIO_WAITFORVSYNC, &arg)) {
+			fb->vsync = 0; // not supported, stop asking
+		}
+	}
+	fb->var.yoffset = fb->backPage * fb->var.yres;
+	if (ioctl(fb->fd, FBIOPAN_DISPLAY, &fb->var)) {
+		// driver stopped panning: keep showing page 0 and copy into it from now on
+		fb->var.yoffset = 0;
+		ioctl(fb->fd, FBIOPAN_DISPLAY, &fb->var);
+		fb->pageCount = 1;
+		fb->backPage = 0;
+		fb->pendingCount[0] = fb->pendingCount[1] = 0; // covered by the full redraw
+		selectBackPage(fb);
+		return 1;
+	}
+	fb->backPage ^= 1;
+	selectBackPage(fb);
+	return 0;
+}
+
+/* OUTPUT BACKENDS ----------------------------------------------------- */
+
+// open and map a framebuffer device. Returns 0, or the exit code for what failed.
+int openFramebufferOutput(FrameBuffer* fb, const char* device, int wantFlip, int wantVsync) {
+	struct fb_var_screeninfo vInfo; // variable screen info
+	struct fb_fix_screeninfo sInfo; // static screen info
+	int fbFile;	 // frame buffer file descriptor
+	fbFile = open(device,O_RDWR);
+	if (fbFile < 0) {
+		printf("Error: cannot open framebuffer device.\n");
+		return 1;
+	}
+	if (ioctl (fbFile, FBIOGET_VSCREENINFO, &vInfo)) {
+		printf("Error reading variable information.\n");
+		close(fbFile);
+		return 3;
+	}
+	
+	// flipping can change the layout, so read the fixed info afterwards
+	setupPageFlip(fb, fbFile, &vInfo, wantFlip);
+	fb->vsync = wantVsync;
+	if (ioctl (fbFile, FBIOGET_FSCREENINFO, &sInfo)) {
+		printf("Error reading fixed information.\n");
+		undoPageFlip(fb);
+		close(fbFile);
+		return 2;
+	}
+	fb->output = outputFramebuffer;
+	fb->sink = NULL;
+	fb->sinkRow = NULL;
+	fb->smemLen = sInfo.smem_len;
+	fb->lineLen = sInfo.line_length;
+	fb->bpp = vInfo.bits_per_pixel;
+	// never draw past the end of a line or of a page
+	fb->width = min((int)vInfo.xres, fb->lineLen / (fb->bpp/8));
+	fb->height = min((int)vInfo.yres, fb->smemLen / fb->pageCount / fb->lineLen);
+	choosePresentKernel(fb, &vInfo);
+	chooseSinkKernel(fb);
+	
+	// and map the framebuffer to the FB struct.
+	fb->base = (char*)mmap(0, sInfo.smem_len, PROT_READ | PROT_WRITE, MAP_SHARED, fbFile, 0);
+	if ((long int)fb->base == -1) {
+		printf ("Error: failed to map framebuffer device to memory.\n");
+		undoPageFlip(fb);
+		close(fbFile);
+		return 4;
+	}
+	selectBackPage(fb);
+	return 0;
+}
+
+// a width x height BGRA buffer in memory, optionally dumped to path after every frame
+int openMemoryOutput(FrameBuffer* fb, int output, const char* path, int width, int height) {
+	struct fb_var_screeninfo vInfo;
+	memset(&vInfo, 0, sizeof(vInfo));
+	vInfo.xres = vInfo.xres_virtual = width;
+	vInfo.yres = vInfo.yres_virtual = height;
+	vInfo.bits_per_pixel = 32;
+	vInfo.blue.offset = 0;
+	vInfo.green.offset = 8;
+	vInfo.red.offset = 16;
+	vInfo.transp.offset = 24;
+	vInfo.red.length = vInfo.green.length = vInfo.blue.length = vInfo.transp.length = 8;
+	
+	setupPageFlip(fb, -1, &vInfo, 0);
+	fb->vsync = 0;
+	fb->output = output;
+	fb->sink = NULL;
+	fb->sinkRow = NULL;
+	fb->width = width;
+	fb->height = height;
+	fb->lineLen = width * 4;
+	fb->smemLen = fb->lineLen * height;
+	fb->bpp = 32;
+	choosePresentKernel(fb, &vInfo);
+	chooseSinkKernel(fb);
+	fb->base = (char*)calloc(fb->smemLen, 1);
+	if (!fb->base) {
+		printf("Error: cannot allocate output buffer.\n");
+		return 4;
+	}
+	selectBackPage(fb);
+	
+	if (output == outputPPM || output == outputRaw) {
+		fb->sink = fopen(path, "wb");
+		if (!fb->sink) {
+			printf("Error: cannot open %s for writing.\n", path);
+			return 1;
+		}
+		fb->sinkRow = (unsigned char*)malloc(width * 3);
+	}
+	return 0;
+}
+
+// hand the finished frame to file outputs
+void endFrame(FrameBuffer* fb) {
+	if (fb->writeFrame) {
+		fb->writeFrame(fb);
+	}
+}
+
+void closeOutput(FrameBuffer* fb) {
+	if (fb->output == outputFramebuffer) {
+		undoPageFlip(fb);
+		munmap(fb->base, fb->smemLen);
+		close(fb->fd);
+		return;
+	}
+	if (fb->sink) {
+		fclose(fb->sink);
+	}
+	free(fb->sinkRow);
+	free(fb->base);
+}
+
+void rasterCircle(Frame* frm,int xm, int ym, int r,RGB col)
+{
+   int x = -r, y = 0, err = 2-2*r; /* II. Quadrant */ 
+   do {
+      insertPixel(frm,coord(xm-x, ym+y),col); /*   I. Quadrant */
+      insertPixel(frm,coord(xm-y, ym-x),col); /*  II. Quadrant */
+      insertPixel(frm,coord(xm+x, ym-y),col); /* III. Quadrant */
+      insertPixel(frm,coord(xm+y, ym+x),col); /*  IV. Quadrant */
+      r = err;
+      if (r <= y) err += ++y*2+1;           /* e_xy+e_y < 0 */
+      if (r > x || err > y) err += ++x*2+1; /* e_xy+e_x > 0 or no 2nd y-step */
+   } while (x < 0);
+}
+
+void rasterHalfCircle(Frame *frm,int xm, int ym, int r,RGB col)
+{
+   int x = -r, y = 0, err = 2-2*r; /* II. Quadrant */ 
+   do {
+      insertPixel(frm,coord(xm+x, ym-y),col); /* III. Quadrant */
+      insertPixel(frm,coord(xm+y, ym+x),col); /*  IV. Quadrant */
+      r = err;
+      if (r <= y) err += ++y*2+1;           /* e_xy+e_y < 0 */
+      if (r > x || err > y) err += ++x*2+1; /* e_xy+e_x > 0 or no 2nd y-step */
+   } while (x < 0);
+}
+
+/* FILLED ELLIPSES ---------------------------------------------------- */
+// Filled ellipses and pie slices of them go row by row: the row's part of the
+// ellipse is one run, cut down to at most two by the slice, and written with
+// hspan. Smooth edges blend the few pixels the outline passes through by how
+// much of them is inside, from their distance to it.
+
+//Pie slice between two angles, in pixel offsets from the center with y down.
+//Inside means a*dx + b*dy >= 0 for the start half-plane, c*dx + d*dy >= 0 for
+//the end one, and both (convex slices) or either (wider ones).
+typedef struct s_slice {
+	int full; // no slice, the whole ellipse
+	int convex; // sweeps 180 degrees or less
+	float a, b, c, d;
+} Slice;
+
+// slice from `from` to `to` degrees, counterclockwise as seen on screen from +x
+Slice makeSlice(float from, float to) {
+	Slice sl;
+	float sweep = to - from;
+	sl.full = sweep >= 360 || sweep <= -360;
+	if (sweep < 0) sweep += 360;
+	sl.convex = sweep <= 180;
+	sl.a = -sinf(degreesToRadians(from));
+	sl.b = -cosf(degreesToRadians(from));
+	sl.c = sinf(degreesToRadians(to));
+	sl.d = cosf(degreesToRadians(to));
+	return sl;
+}
+
+// offsets dx of row dy with a*dx + b*dy >= 0, as [*lo, *hi]
+void halfPlaneRow(float a, float b, int dy, int* lo, int* hi) {
+	const float eps = 1e-4f;
+	float rest = b * dy;
+	*lo = -0x7fffffff;
+	*hi = 0x7fffffff;
+	if (a > eps) {
+		*lo = (int)ceilf(-rest / a - eps);
+	} else if (a < -eps) {
+		*hi = (int)floorf(-rest / a + eps);
+	} else if (rest < -eps) {
+		*lo = 1;
+		*hi = 0;
+	}
+}
+
+// the runs of [lo, hi] on row dy that are inside the slice, as pairs in spans; returns how many
+int sliceRow(const Slice* sl, int dy, int lo, int hi, int* spans) {
+	int lo0, hi0, lo1, hi1;
+	if (sl->full) {
+		spans[0] = lo;
+		spans[1] = hi;
+		return lo <= hi;
+	}
+	halfPlaneRow(sl->a, sl->b, dy, &lo0, &hi0);
+	halfPlaneRow(sl->c, sl->d, dy, &lo1, &hi1);
+	if (sl->convex) {
+		spans[0] = max(lo, max(lo0, lo1));
+		spans[1] = min(hi, min(hi0, hi1));
+		return spans[0] <= spans[1];
+	}
+	// either half-plane: two runs, or one where they meet
+	lo0 = max(lo, lo0);
+	hi0 = min(hi, hi0);
+	lo1 = max(lo, lo1);
+	hi1 = min(hi, hi1);
+	if (lo0 > hi0) {
+		lo0 = lo1;
+		hi0 = hi1;
+		lo1 = 1;
+		hi1 = 0;
+	}
+	if (lo0 > hi0) return 0;
+	if (lo1 > hi1) {
+		spans[0] = lo0;
+		spans[1] = hi0;
+		return 1;
+	}
+	if (lo1 <= hi0 + 1 && lo0 <= hi1 + 1) {
+		spans[0] = min(lo0, lo1);
+		spans[1] = max(hi0, hi1);
+		return 1;
+	}
+	spans[0] = min(lo0, lo1);
+	spans[1] = lo0 < lo1 ? hi0 : hi1;
+	spans[2] = max(lo0, lo1);
+	spans[3] = lo0 < lo1 ? hi1 : hi0;
+	return 2;
+}
+
+int insideSlice(const Slice* sl, int dx, int dy) {
+	if (sl->full) return 1;
+	int s = sl->a * dx + sl->b * dy >= -1e-4f;
+	int e = sl->c * dx + sl->d * dy >= -1e-4f;
+	return sl->convex ? s && e : s || e;
+}
+
+// half width of an ellipse with radii ex, ey on row dy, -1 when the row misses it
+float ellipseHalfWidth(float ex, float ey, int dy) {
+	float t = 1 - (dy / ey) * (dy / ey);
+	return t < 0 ? -1 : ex * sqrtf(t);
+}
+
+// fill the ellipse with radii rx, ry around (xm, ym), or its slice from arcFrom
+// to arcTo degrees, with smooth edges when smooth is set. The edge runs half a
+// pixel outside the radii, so a radius 0 ellipse is one pixel.
+void rasterEllipse(Frame* frm, int xm, int ym, int rx, int ry, float arcFrom, float arcTo, int smooth, RGB col) {
+	Slice sl = makeSlice(arcFrom, arcTo);
+	Pixel p = pixel(col);
+	float ex = rx + 0.5f, ey = ry + 0.5f;
+	int reach = ry + (smooth ? 1 : 0);
+	int firstY = max(-reach, frm->clip.y0 - ym);
+	int lastY = min(reach, frm->clip.y1 - 1 - ym);
+	int spans[4];
+	int dy, dx, i, n;
+	for (dy=firstY; dy<=lastY; dy++) {
+		if (!smooth) {
+			int w = (int)ellipseHalfWidth(ex, ey, dy);
+			n = sliceRow(&sl, dy, -w, w, spans);
+			for (i=0; i<n; i++) {
+				hspan(frm, ym + dy, xm + spans[2*i], xm + spans[2*i+1], p);
+			}
+			continue;
+		}
+		// pixels within half a pixel of the outline are blended, the ones inside them solid
+		float outer = ellipseHalfWidth(ex + 0.5f, ey + 0.5f, dy);
+		if (outer < 0) continue;
+		int wo = (int)ceilf(outer);
+		int wi = ey > 0.5f ? (int)floorf(ellipseHalfWidth(ex - 0.5f, ey - 0.5f, dy)) : -1;
+		n = sliceRow(&sl, dy, -wi, wi, spans);
+		for (i=0; i<n; i++) {
+			hspan(frm, ym + dy, xm + spans[2*i], xm + spans[2*i+1], p);
+		}
+		int y = ym + dy;
+		Pixel* row = frameRow(frm, y);
+		for (dx=-wo; dx<=wo; dx++) {
+			if (wi >= 0 && dx == -wi) {
+				dx = wi; // skip the solid part
+				continue;
+			}
+			int x = xm + dx;
+			if (x < frm->clip.x0 || x >= frm->clip.x1 || !insideSlice(&sl, dx, dy)) continue;
+			// distance to the outline: how far the ellipse's level is past 1, over its slope
+			float u = dx / ex, v = dy / ey;
+			float f = sqrtf(u*u + v*v);
+			float cover = 1;
+			if (f > 1e-6f) {
+				float slope = sqrtf((u/ex)*(u/ex) + (v/ey)*(v/ey)) / f;
+				cover = 0.5f - (f - 1) / slope;
+			}
+			if (cover <= 0) continue;
+			pixelsWritten++;
+			if (cover >= 1) {
+				row[x] = p;
+			} else {
+				blendPixel(&row[x], p, (int)(cover * 256));
+			}
+		}
+	}
+}
+
+/* Fungsi membuat garis */
+// Bresenham moves the major axis one pixel per step and the minor axis by
+// floor((2*k*minor + n) / (2*n)) after k of its n steps, so clipping can be
+// done exactly in step space instead of per pixel.
+
+// first step whose minor offset reaches t
+long long lineStepReaching(long long t, int minor, int n) {
+	if (t <= 0) return 0;
+	if (minor == 0) return (long long)n + 1;
+	return ((2*t - 1) * n + 2*minor - 1) / (2*minor);
+}
+
+// limit the steps of one axis to the offsets that stay inside lo..hi
+int clipLineAxis(int p0, int s, int d, int n, int lo, int hi, long long* kFirst, long long* kLast) {
+	long long oLo = s > 0 ? lo - p0 : p0 - hi;
+	long long oHi = s > 0 ? hi - p0 : p0 - lo;
+	if (oHi < 0 || oLo > d) return 0;
+	if (d == n) {
+		*kFirst = max(*kFirst, oLo);
+		*kLast = min(*kLast, oHi);
+	} else {
+		*kFirst = max(*kFirst, lineStepReaching(oLo, d, n));
+		*kLast = min(*kLast, lineStepReaching(oHi + 1, d, n) - 1);
+	}
+	return *kFirst <= *kLast;
+}
+
+void rasterLine(Frame* frm, int x0, int y0, int x1, int y1, RGB lineColor)
+{
+	// axis-aligned lines are runs
+	if (y0 == y1) {
+		hspan(frm, y0, min(x0, x1), max(x0, x1), pixel(lineColor));
+		return;
+	}
+	if (x0 == x1) {
+		vspan(frm, x0, min(y0, y1), max(y0, y1), pixel(lineColor));
+		return;
+	}
+	int dx = abs(x1-x0), sx = x0<x1 ? 1 : -1;
+	int dy = abs(y1-y0), sy = y0<y1 ? 1 : -1;
+	int n = max(dx, dy);
+	int minor = min(dx, dy);
+	Rect clip = frm->clip;
+	
+	// steps that land inside the clip, an empty range culls the line
+	long long kFirst = 0, kLast = n;
+	if (!clipLineAxis(x0, sx, dx, n, clip.x0, clip.x1 - 1, &kFirst, &kLast)) return;
+	if (!clipLineAxis(y0, sy, dy, n, clip.y0, clip.y1 - 1, &kFirst, &kLast)) return;
+	
+	// jump to the first visible step, then walk without bounds checks
+	int k = kFirst;
+	long long twoN = n ? 2LL*n : 1;
+	long long num = 2LL*k*minor + n;
+	int m = num / twoN;
+	long long rem = num % twoN;
+	int majorStep, minorStep;
+	long idx;
+	if (dx >= dy) {
+		idx = (long)(y0 + sy*m) * frm->stride + x0 + sx*k;
+		majorStep = sx;
+		minorStep = sy * frm->stride;
+	} else {
+		idx = (long)(y0 + sy*k) * frm->stride + x0 + sx*m;
+		majorStep = sy * frm->stride;
+		minorStep = sx;
+	}
+	Pixel* dst = frm->px;
+	Pixel p = pixel(lineColor);
+	pixelsWritten += kLast - kFirst + 1;
+	for (; k<=kLast; k++) {
+		dst[idx] = p;
+		idx += majorStep;
+		rem += 2*minor;
+		if (rem >= twoN) {
+			rem -= twoN;
+			idx += minorStep;
+		}
+	}
+}
+
+// store a pixel already known to be inside the clip
+void putPixel(Frame* frm, int x, int y, RGB col) {
+	frameRow(frm, y)[x] = pixel(col);
+	pixelsWritten++;
+}
+
+// wide line pixel, fading with its distance f from the edge
+void widthPixel(Frame* frm, int x, int y, RGB col, float f, int inside) {
+	RGB c = rgb(max(0,col.r*f), max(0,col.g*f), max(0,col.b*f));
+	if (inside) {
+		putPixel(frm, x, y, c);
+	} else {
+		insertPixel(frm, coord(x, y), c);
+	}
+}
+
+void rasterLineWidth(Frame* frm, int x0, int y0, int x1, int y1, float wd, RGB lineColor) { 
+	int dx = abs(x1-x0), sx = x0 < x1 ? 1 : -1; 
+	int dy = abs(y1-y0), sy = y0 < y1 ? 1 : -1; 
+	int err = dx-dy, e2, x2, y2;                          /* error value e_xy */
+
+	float ed = dx+dy == 0 ? 1 : sqrt((float)dx*dx+(float)dy*dy);
+	
+	// all pixels stay within pad of the line's box; if that is inside the clip
+	// nothing needs checking, if it misses the clip nothing is drawn
+	int pad = (int)wd + 2;
+	Rect clip = frm->clip;
+	Rect box = rect(min(x0,x1) - pad, min(y0,y1) - pad, max(x0,x1) + pad + 1, max(y0,y1) + pad + 1);
+	if (box.x1 <= clip.x0 || box.x0 >= clip.x1 || box.y1 <= clip.y0 || box.y0 >= clip.y1) return;
+	int inside = box.x0 >= clip.x0 && box.x1 <= clip.x1 && box.y0 >= clip.y0 && box.y1 <= clip.y1;
+
+	for (wd = (wd+1)/2; ; ) {                                   /* pixel loop */
+		// the walk is monotonic, once past the clip on either axis it's done
+		int inCol = x0 >= clip.x0 && x0 < clip.x1;
+		int inRow = y0 >= clip.y0 && y0 < clip.y1;
+		if ((sx > 0 ? x0 >= clip.x1 : x0 < clip.x0) || (sy > 0 ? y0 >= clip.y1 : y0 < clip.y0)) break;
+		if (inCol && inRow) {
+			widthPixel(frm, x0, y0, lineColor, abs(err-dx+dy)/ed-wd+1, inside);
+		}
+
+		e2 = err; x2 = x0;
+		if (2*e2 >= -dx) {                                           /* x step */
+			if (inCol) {
+				for (e2 += dy, y2 = y0; e2 < ed*wd && (y1 != y2 || dx > dy); e2 += dx)
+					y2 += sy;
+				widthPixel(frm, x0, y2, lineColor, abs(e2)/ed-wd+1, inside);
+			}
+			if (x0 == x1) break;
+			e2 = err; err -= dy; x0 += sx; 
+		} 
+		
+		if (2*e2 <= dy) {                                            /* y step */
+			if (inRow) {
+				for (e2 = dx-e2; e2 < ed*wd && (x1 != x2 || dx < dy); e2 += dy)
+					x2 += sx;
+				widthPixel(frm, x2, y0, lineColor, abs(e2)/ed-wd+1, inside);
+			}
+			if (y0 == y1) break;
+			err += dx; y0 += sy; 
+		}
+	}
+}
+
+vector<Coord> getBirdCoordinate(Coord center) {
+	vector<Coord> birdCoord;
+
+	birdCoord.push_back(coord(center.x, center.y));
+	birdCoord.push_back(coord(birdCoord.at(0).x+10, birdCoord.at(0).y-5));
+	birdCoord.push_back(coord(birdCoord.at(1).x+13, birdCoord.at(1).y+7));
+	birdCoord.push_back(coord(birdCoord.at(2).x-10, birdCoord.at(2).y+5));
+	birdCoord.push_back(coord(birdCoord.at(3).x-10, birdCoord.at(3).y-5));
+
+	return birdCoord;
+}
+
+/* FUNCTIONS FOR SCANLINE ALGORITHM ---------------------------------------------------- */
+
+//Polygon edge for the scanline filler, x in 16.16 fixed point
+typedef struct s_edge {
+	int yTop;    // first row crossed
+	int yBottom; // row after the last one crossed
+	int x;       // x on the current row
+	int dxdy;    // x step per row
+} Edge;
+
+// scanline-fill polygon rows startY..endY, offset by (xOffset, yOffset), using an
+// edge table sorted by top row and an active edge list stepped in fixed point.
+// Edges cover rows [yTop, yBottom), so a vertex where the outline passes straight
+// through is counted once and a peak or valley twice (or not at all), and every row
+// gets an even number of crossings.
+void rasterFill(Frame *frame, int xOffset, int yOffset, int startY, int endY, const Coord* poly, int n, RGB color) {
+	Edge edgeBuf[64];
+	vector<Edge> edgeHeap;
+	Edge* edges = edgeBuf;
+	if (n > 64) {
+		edgeHeap.resize(n);
+		edges = &edgeHeap[0];
+	}
+	Edge* activeBuf[64];
+	vector<Edge*> activeHeap;
+	Edge** active = activeBuf;
+	if (n > 64) {
+		activeHeap.resize(n);
+		active = &activeHeap[0];
+	}
+	
+	// rows outside the clip can't produce pixels
+	Rect clip = frame->clip;
+	int firstY = max(startY, clip.y0 - yOffset);
+	int lastY = min(endY, clip.y1 - 1 - yOffset);
+	if (firstY > lastY) return;
+	
+	// edge table, horizontal edges never cross a row
+	int edgeCount = 0;
+	int i, j;
+	for (i=0; i<n; i++) {
+		Coord a = poly[i];
+		Coord b = poly[(i + 1) % n];
+		if (a.y == b.y) continue;
+		if (a.y > b.y) {
+			Coord t = a;
+			a = b;
+			b = t;
+		}
+		if (b.y <= firstY || a.y > lastY) continue;
+		Edge e;
+		e.yTop = a.y;
+		e.yBottom = b.y;
+		e.dxdy = (int)((long long)(b.x - a.x) * 65536 / (b.y - a.y));
+		e.x = a.x * 65536 + 0x8000; // + half, so >>16 rounds
+		if (e.yTop < firstY) {
+			e.x += (firstY - e.yTop) * e.dxdy;
+			e.yTop = firstY;
+		}
+		// insertion sort by top row
+		for (j=edgeCount; j>0 && edges[j-1].yTop > e.yTop; j--) {
+			edges[j] = edges[j-1];
+		}
+		edges[j] = e;
+		edgeCount++;
+	}
 	
-	if(counter % 2 == 0){
-		plotLine(frm,loc.x,loc.y+30,loc.x+20,loc.y+sel-3,color);
-		plotLine(frm,loc.x,loc.y+30,loc.x+25,loc.y+(sel+10)-3,color);
-	}else{
-		plotLine(frm,loc.x,loc.y+30,loc.x+20,loc.y+sel,color);
-		plotLine(frm,loc.x,loc.y+30,loc.x+25,loc.y+(sel+10),color);
+	Pixel p = pixel(color);
+	int nextEdge = 0;
+	int activeCount = 0;
+	int y;
+	for (y=firstY; y<=lastY; y++) {
+		// retire finished edges, take in the ones starting here
+		for (i=0, j=0; i<activeCount; i++) {
+			if (active[i]->yBottom > y) active[j++] = active[i];
+		}
+		activeCount = j;
+		while (nextEdge < edgeCount && edges[nextEdge].yTop == y) {
+			active[activeCount++] = &edges[nextEdge++];
+		}
+		if (activeCount == 0 && nextEdge == edgeCount) break;
+		
+		// keep the list ordered by x, it is almost sorted from the last row
+		for (i=1; i<activeCount; i++) {
+			Edge* e = active[i];
+			for (j=i; j>0 && active[j-1]->x > e->x; j--) {
+				active[j] = active[j-1];
+			}
+			active[j] = e;
+		}
+		
+		for (i=0; i+1<activeCount; i+=2) {
+			hspan(frame, y + yOffset, (active[i]->x >> 16) + xOffset, (active[i+1]->x >> 16) + xOffset, p);
+		}
+		for (i=0; i<activeCount; i++) {
+			active[i]->x += active[i]->dxdy;
+		}
+	}
+}
+
+// copy the sprite's runs with its anchor at (x,y), limited to the clip
+void rasterSprite(Frame* frm, const Sprite* spr, int x, int y) {
+	size_t i;
+	for (i=0; i<spr->runs.size(); i++) {
+		const SpriteRun* run = &spr->runs[i];
+		hspan(frm, y + run->y, x + run->x0, x + run->x1 - 1, spr->color);
+	}
+}
+
+/* TILED RENDERER ------------------------------------------------------ */
+
+// rasterize count recorded commands of one type, limited to the frame's clip
+void executeBatch(Renderer* rdr, Frame* frm, int type, const int* list, int count) {
+	const DrawCmd* cmds = &rdr->cmds[0];
+	const DrawCmd* cmd;
+	int i, j;
+	switch (type) {
+		case cmdClear:
+			for (i=0; i<count; i++) {
+				cmd = &cmds[list[i]];
+				rasterClear(frm, cmd->box, cmd->color);
+			}
+			break;
+		case cmdLine:
+			for (i=0; i<count; i++) {
+				cmd = &cmds[list[i]];
+				rasterLine(frm, cmd->x0, cmd->y0, cmd->x1, cmd->y1, cmd->color);
+			}
+			break;
+		case cmdLineWidth:
+			for (i=0; i<count; i++) {
+				cmd = &cmds[list[i]];
+				rasterLineWidth(frm, cmd->x0, cmd->y0, cmd->x1, cmd->y1, cmd->wd, cmd->color);
+			}
+			break;
+		case cmdCircle:
+			for (i=0; i<count; i++) {
+				cmd = &cmds[list[i]];
+				rasterCircle(frm, cmd->x0, cmd->y0, cmd->x1, cmd->color);
+			}
+			break;
+		case cmdHalfCircle:
+			for (i=0; i<count; i++) {
+				cmd = &cmds[list[i]];
+				rasterHalfCircle(frm, cmd->x0, cmd->y0, cmd->x1, cmd->color);
+			}
+			break;
+		case cmdFill:
+			for (i=0; i<count; i++) {
+				cmd = &cmds[list[i]];
+				rasterFill(frm, cmd->x0, cmd->y0, cmd->x1, cmd->y1, &rdr->polys[cmd->polyStart], cmd->polyCount, cmd->color);
+			}
+			break;
+		case cmdSprite:
+			for (i=0; i<count; i++) {
+				cmd = &cmds[list[i]];
+				rasterSprite(frm, cmd->sprite, cmd->x0, cmd->y0);
+			}
+			break;
+		case cmdEllipse:
+			for (i=0; i<count; i++) {
+				cmd = &cmds[list[i]];
+				rasterEllipse(frm, cmd->x0, cmd->y0, cmd->x1, cmd->y1, cmd->arcFrom, cmd->arcTo, cmd->smooth, cmd->color);
+			}
+			break;
+		case cmdStreaks:
+			for (i=0; i<count; i++) {
+				cmd = &cmds[list[i]];
+				for (j=cmd->polyStart; j<cmd->polyStart+cmd->polyCount; j++) {
+					const Streak* s = &rdr->streaks[j];
+					rasterLine(frm, s->x0, s->y0, s->x1, s->y1, s->color);
+				}
+			}
+			break;
+	}
+}
+
+// the one color a command writes, 0 when it writes several or blends
+Pixel cmdInk(const DrawCmd* cmd) {
+	if (cmd->type == cmdStreaks || cmd->type == cmdLineWidth) return 0; // thick lines fade at the edges
+	if (cmd->type == cmdEllipse && cmd->smooth) return 0;
+	if (cmd->type == cmdSprite) return cmd->sprite->color;
+	return pixel(cmd->color);
+}
+
+// Commands with a single ink overwrite the pixels they cover, so commands of
+// the same ink give the same result in any order. Each run of
+// those in a tile's list is grouped by type, keeping the recorded order within
+// a type, so the tile runs a few long batches instead of switching primitive
+// at every command.
+void batchTileCmds(Renderer* rdr, vector<int>& list, vector<int>& scratch) {
+	size_t start = 0, end, i;
+	int count[cmdTypes + 1];
+	int type;
+	scratch.resize(list.size());
+	while (start < list.size()) {
+		Pixel ink = cmdInk(&rdr->cmds[list[start]]);
+		end = start + 1;
+		while (ink && end < list.size() && cmdInk(&rdr->cmds[list[end]]) == ink) end++;
+		if (end - start > 1) {
+			// counting sort on the type
+			memset(count, 0, sizeof(count));
+			for (i=start; i<end; i++) {
+				count[rdr->cmds[list[i]].type + 1]++;
+			}
+			for (type=0; type<cmdTypes; type++) {
+				count[type + 1] += count[type];
+			}
+			for (i=start; i<end; i++) {
+				scratch[start + count[rdr->cmds[list[i]].type]++] = list[i];
+			}
+			copy(scratch.begin() + start, scratch.begin() + end, list.begin() + start);
+		}
+		start = end;
+	}
+}
+
+// take tiles off the shared counter and run their commands, batched by type.
+// worker is 0 for the calling thread and 1.. for the pool.
+void renderTiles(Renderer* rdr, int worker) {
+	vector<int>& scratch = rdr->batchScratch[worker];
+	size_t i, end;
+	int t;
+	while ((t = rdr->nextTile++) < rdr->tilesX*rdr->tilesY) {
+		vector<int>& list = rdr->tiles[t];
+		if (list.empty()) continue;
+		int tx = t % rdr->tilesX;
+		int ty = t / rdr->tilesX;
+		// draw through a view of the target clipped to this tile
+		Frame tile = *rdr->target;
+		Rect c = tile.clip;
+		tile.clip = rect(max(c.x0, tx*tileSize), max(c.y0, ty*tileSize), min(c.x1, (tx+1)*tileSize), min(c.y1, (ty+1)*tileSize));
+		batchTileCmds(rdr, list, scratch);
+		for (i=0; i<list.size(); i=end) {
+			int type = rdr->cmds[list[i]].type;
+			for (end=i+1; end<list.size() && rdr->cmds[list[end]].type == type; end++);
+			executeBatch(rdr, &tile, type, &list[i], end - i);
+		}
+	}
+}
+
+void rendererWorker(Renderer* rdr, int worker) {
+	int seen = 0;
+	unique_lock<mutex> guard(rdr->lock);
+	while (1) {
+		while (!rdr->quit && rdr->generation == seen) {
+			rdr->wake.wait(guard);
+		}
+		if (rdr->quit) return;
+		seen = rdr->generation;
+		guard.unlock();
+		long long before = pixelsWritten;
+		renderTiles(rdr, worker);
+		rdr->workerPixels += pixelsWritten - before;
+		guard.lock();
+		if (--rdr->busy == 0) {
+			rdr->done.notify_one();
+		}
+	}
+}
+
+// spawn threadCount-1 workers for frames up to width x height; the thread
+// calling renderFrame is the last one
+void startRenderer(Renderer* rdr, int threadCount, int width, int height) {
+	int i;
+	rdr->tilesX = (width + tileSize - 1) / tileSize;
+	rdr->tilesY = (height + tileSize - 1) / tileSize;
+	rdr->tiles.resize(rdr->tilesX * rdr->tilesY);
+	rdr->tileStart.resize(rdr->tilesX * rdr->tilesY + 1);
+	rdr->tileFill.resize(rdr->tilesX * rdr->tilesY);
+	rdr->threadCount = max(1, threadCount);
+	rdr->batchScratch.resize(rdr->threadCount);
+	rdr->generation = 0;
+	rdr->busy = 0;
+	rdr->quit = 0;
+	rdr->nextTile = 0;
+	rdr->workerPixels = 0;
+	rdr->target = NULL;
+	rdr->cmds.reserve(4096);
+	rdr->polys.reserve(4096);
+	rdr->streaks.reserve(4096);
+	for (i=1; i<rdr->threadCount; i++) {
+		rdr->workers.push_back(thread(rendererWorker, rdr, i));
+	}
+}
+
+void stopRenderer(Renderer* rdr) {
+	{
+		lock_guard<mutex> guard(rdr->lock);
+		rdr->quit = 1;
+	}
+	rdr->wake.notify_all();
+	for (size_t i=0; i<rdr->workers.size(); i++) {
+		rdr->workers[i].join();
+	}
+	rdr->workers.clear();
+}
+
+// rasterize everything recorded for frm since the last call, on all threads
+void renderFrame(Renderer* rdr, Frame* frm) {
+	int t, tx, ty;
+	size_t i;
+	
+	// bin commands into the tiles their bounding box overlaps
+	for (t=0; t<rdr->tilesX*rdr->tilesY; t++) {
+		rdr->tiles[t].clear();
+	}
+	for (i=0; i<rdr->cmds.size(); i++) {
+		Rect b = rdr->cmds[i].box;
+		for (ty=b.y0/tileSize; ty<=(b.y1-1)/tileSize; ty++) {
+			for (tx=b.x0/tileSize; tx<=(b.x1-1)/tileSize; tx++) {
+				rdr->tiles[ty*rdr->tilesX + tx].push_back(i);
+			}
+		}
 	}
 	
+	rdr->target = frm;
+	rdr->nextTile = 0;
+	{
+		lock_guard<mutex> guard(rdr->lock);
+		rdr->generation++;
+		rdr->busy = rdr->workers.size();
+	}
+	rdr->wake.notify_all();
+	renderTiles(rdr, 0);
+	{
+		unique_lock<mutex> guard(rdr->lock);
+		while (rdr->busy > 0) {
+			rdr->done.wait(guard);
+		}
+	}
 	
+	rdr->cmds.clear();
+	rdr->polys.clear();
+	rdr->streaks.clear();
 }
 
-void drawCannon(Frame* frm,Coord loc,RGB color){
+/* DRAWING PRIMITIVES -------------------------------------------------- */
+// Each reports its bounding box to the damage tracker, then either records
+// itself for the frame's renderer or rasterizes right away.
+
+void plotCircle(Frame* frm,int xm, int ym, int r,RGB col) {
+	Rect box = rect(xm-r, ym-r, xm+r+1, ym+r+1);
+	markDirty(frm, box.x0, box.y0, box.x1, box.y1);
+	if (frm->renderer) {
+		DrawCmd* cmd = recordCmd(frm, cmdCircle, box, col);
+		if (cmd) {
+			cmd->x0 = xm;
+			cmd->y0 = ym;
+			cmd->x1 = r;
+		}
+		return;
+	}
+	rasterCircle(frm, xm, ym, r, col);
+}
+
+void plotHalfCircle(Frame *frm,int xm, int ym, int r,RGB col) {
+	Rect box = rect(xm-r, ym-r, xm+r+1, ym+1);
+	markDirty(frm, box.x0, box.y0, box.x1, box.y1);
+	if (frm->renderer) {
+		DrawCmd* cmd = recordCmd(frm, cmdHalfCircle, box, col);
+		if (cmd) {
+			cmd->x0 = xm;
+			cmd->y0 = ym;
+			cmd->x1 = r;
+		}
+		return;
+	}
+	rasterHalfCircle(frm, xm, ym, r, col);
+}
+
+// filled ellipse, or the slice of it from arcFrom to arcTo degrees; see rasterEllipse()
+void plotEllipse(Frame* frm, int xm, int ym, int rx, int ry, float arcFrom, float arcTo, int smooth, RGB col) {
+	Rect box = rect(xm-rx-1, ym-ry-1, xm+rx+2, ym+ry+2);
+	markDirty(frm, box.x0, box.y0, box.x1, box.y1);
+	if (frm->renderer) {
+		DrawCmd* cmd = recordCmd(frm, cmdEllipse, box, col);
+		if (cmd) {
+			cmd->x0 = xm;
+			cmd->y0 = ym;
+			cmd->x1 = rx;
+			cmd->y1 = ry;
+			cmd->arcFrom = arcFrom;
+			cmd->arcTo = arcTo;
+			cmd->smooth = smooth;
+		}
+		return;
+	}
+	rasterEllipse(frm, xm, ym, rx, ry, arcFrom, arcTo, smooth, col);
+}
+
+void plotDisc(Frame* frm, int xm, int ym, int r, int smooth, RGB col) {
+	plotEllipse(frm, xm, ym, r, r, 0, 360, smooth, col);
+}
+
+void plotLine(Frame* frm, int x0, int y0, int x1, int y1, RGB lineColor) {
+	Rect box = rect(min(x0,x1), min(y0,y1), max(x0,x1)+1, max(y0,y1)+1);
+	markDirty(frm, box.x0, box.y0, box.x1, box.y1);
+	if (frm->renderer) {
+		DrawCmd* cmd = recordCmd(frm, cmdLine, box, lineColor);
+		if (cmd) {
+			cmd->x0 = x0;
+			cmd->y0 = y0;
+			cmd->x1 = x1;
+			cmd->y1 = y1;
+		}
+		return;
+	}
+	rasterLine(frm, x0, y0, x1, y1, lineColor);
+}
+
+void plotLineWidth(Frame* frm, int x0, int y0, int x1, int y1, float wd, RGB lineColor) {
+	// the side steps never reach further than the width past the end points
+	int pad = (int)wd + 2;
+	Rect box = rect(min(x0,x1)-pad, min(y0,y1)-pad, max(x0,x1)+pad+1, max(y0,y1)+pad+1);
+	markDirty(frm, box.x0, box.y0, box.x1, box.y1);
+	if (frm->renderer) {
+		DrawCmd* cmd = recordCmd(frm, cmdLineWidth, box, lineColor);
+		if (cmd) {
+			cmd->x0 = x0;
+			cmd->y0 = y0;
+			cmd->x1 = x1;
+			cmd->y1 = y1;
+			cmd->wd = wd;
+		}
+		return;
+	}
+	rasterLineWidth(frm, x0, y0, x1, y1, wd, lineColor);
+}
+
+void fillPolygon(Frame *frame, int xOffset, int yOffset, int startY, int endY, const vector<Coord>& shapeCoord, RGB color) {
+	int xMin = shapeCoord[0].x;
+	int xMax = shapeCoord[0].x;
+	for (size_t i=1; i<shapeCoord.size(); i++) {
+		xMin = min(xMin, shapeCoord[i].x);
+		xMax = max(xMax, shapeCoord[i].x);
+	}
+	Rect box = rect(xMin + xOffset, startY + yOffset, xMax + xOffset + 1, endY + yOffset + 1);
+	markDirty(frame, box.x0, box.y0, box.x1, box.y1);
+	if (frame->renderer) {
+		Renderer* rdr = frame->renderer;
+		DrawCmd* cmd = recordCmd(frame, cmdFill, box, color);
+		if (cmd) {
+			cmd->x0 = xOffset;
+			cmd->y0 = yOffset;
+			cmd->x1 = startY;
+			cmd->y1 = endY;
+			cmd->polyStart = rdr->polys.size();
+			cmd->polyCount = shapeCoord.size();
+			rdr->polys.insert(rdr->polys.end(), shapeCoord.begin(), shapeCoord.end());
+		}
+		return;
+	}
+	rasterFill(frame, xOffset, yOffset, startY, endY, &shapeCoord[0], shapeCoord.size(), color);
+}
+
+void fillShape(Frame *frame, int xOffset, int yOffset, int startY, int shapeHeight, std::vector<Coord> shapeCoord, RGB color) {
+	fillPolygon(frame, xOffset, yOffset, startY, shapeHeight, shapeCoord, color);
+}
+
+/* SPRITE CACHE -------------------------------------------------------- */
+// Shapes that never change are traced once into a list of covered runs and
+// then blitted wherever they are needed.
+
+#define spriteScratchX 1024 // frame shapes are traced in, around its middle
+#define spriteScratchY 1024
+
+// Outlines of the ship and the plane, relative to the position they are drawn
+// at. Drawing fills them; collision tests rounds against them.
+static const Coord shipOutline[] = {{-80,-40}, {80,-40}, {50,0}, {-50,0}};
+static const Coord planeOutline[] = {
+	{0,31}, {15,26}, {45,23}, {58,19}, {71,16}, {84,21}, {97,25}, {147,22}, {152,4}, {162,0},
+	{165,27}, {164,32}, {165,37}, {96,41}, {109,66}, {99,60}, {82,42}, {45,40}, {18,36}
+};
+#define outlineCount(outline) ((int)(sizeof(outline) / sizeof((outline)[0])))
+
+/* Function to draw ship */
+void traceShip(Frame *frame, Coord center, RGB color)
+{
+	// Ship's attributes
+	int panjangDekBawah = 100;
+	int deltaDekAtasBawah = 60;
+	int height = 40;
+	int jarakKeUjung = panjangDekBawah / 2 + deltaDekAtasBawah / 2;
+	
+	// Ship's relative coordinate to canvas, ship's actuator
+	int xShipCoordinate = center.x - jarakKeUjung;
+	int yShipCoordinate = center.y - height;
+	
+	// Ship's border coordinates
+	vector<Coord>  shipCoordinates;
+	
+	for(int i = 0; i < outlineCount(shipOutline); i++){
+		shipCoordinates.push_back(coord(shipOutline[i].x + jarakKeUjung, shipOutline[i].y + height));
+	}
+		
+	// Draw ship's border relative to canvas
+	for(int i = 0; i < shipCoordinates.size(); i++){
+		int x0, y0, x1, y1;
+		
+		if(i < shipCoordinates.size() - 1){
+			x0 = shipCoordinates.at(i).x + xShipCoordinate;
+			y0 = shipCoordinates.at(i).y + yShipCoordinate;
+			x1 = shipCoordinates.at(i + 1).x + xShipCoordinate;
+			y1 = shipCoordinates.at(i + 1).y + yShipCoordinate;
+		}else{
+			x0 = shipCoordinates.at(shipCoordinates.size() - 1).x + xShipCoordinate;
+			y0 = shipCoordinates.at(shipCoordinates.size() - 1).y + yShipCoordinate;
+			x1 = shipCoordinates.at(0).x + xShipCoordinate;
+			y1 = shipCoordinates.at(0).y + yShipCoordinate;
+		}
+		
+		plotLine(frame, x0, y0, x1, y1, color);
+	}
+	
+	// Coloring ship using scanline algorithm
+	fillPolygon(frame, xShipCoordinate, yShipCoordinate, 1, height, shipCoordinates, color);
+}
+
+void traceCannon(Frame* frm,Coord loc,RGB color){
 	plotLine(frm,loc.x-10,loc.y-10,loc.x-10,loc.y+30,color);
 	plotLine(frm,loc.x-10,loc.y+30,loc.x+10,loc.y+30,color);
 	plotLine(frm,loc.x+10,loc.y+30,loc.x+10,loc.y-10,color);
@@ -507,6 +2511,208 @@ void drawCannon(Frame* frm,Coord loc,RGB color){
 	plotLine(frm,loc.x+5,loc.y-5,loc.x-5,loc.y-5,color);	
 }
 
+void tracePeluru(Frame *frame, Coord center, RGB color)
+{
+	int panjangPeluru = 10;
+	//DrawKiri
+	plotLine(frame, center.x - 3, center.y + panjangPeluru / 2, center.x -3, center.y - panjangPeluru / 2, color); 
+	
+	//DrawKanan
+	plotLine(frame, center.x + 3, center.y + panjangPeluru / 2, center.x + 3, center.y - panjangPeluru / 2, color);
+	
+	//DrawBawah
+	plotLine(frame, center.x - 3, center.y + panjangPeluru / 2, center.x +3, center.y + panjangPeluru / 2, color);
+	
+	//DrawUjungKiri
+	plotLine(frame, center.x - 3, center.y - panjangPeluru / 2, center.x, center.y - (panjangPeluru / 2 + 4), color);
+	
+	//DrawUjungKanan
+	plotLine(frame, center.x + 3, center.y - panjangPeluru / 2, center.x, center.y - (panjangPeluru / 2 + 4), color);
+}
+
+void tracePlane(Frame *frame, Coord position, RGB color) {
+
+	// Ship's relative coordinate to canvas, ship's actuator
+	int xPlaneCoordinate = position.x;
+	int yPlaneCoordinate = position.y;
+	
+	// Ship's border coordinates
+	vector<Coord>  planeCoordinates(planeOutline, planeOutline + outlineCount(planeOutline));
+	
+
+	// Draw ship's border relative to canvas
+	for(int i = 0; i < planeCoordinates.size(); i++){
+		int x0, y0, x1, y1;
+		
+		if(i < planeCoordinates.size() - 1){
+			x0 = planeCoordinates.at(i).x + xPlaneCoordinate;
+			y0 = planeCoordinates.at(i).y + yPlaneCoordinate;
+			x1 = planeCoordinates.at(i + 1).x + xPlaneCoordinate;
+			y1 = planeCoordinates.at(i + 1).y + yPlaneCoordinate;
+		}else{
+			x0 = planeCoordinates.at(planeCoordinates.size() - 1).x + xPlaneCoordinate;
+			y0 = planeCoordinates.at(planeCoordinates.size() - 1).y + yPlaneCoordinate;
+			x1 = planeCoordinates.at(0).x + xPlaneCoordinate;
+			y1 = planeCoordinates.at(0).y + yPlaneCoordinate;
+		}
+		
+		plotLine(frame, x0, y0, x1, y1, color);
+	}
+
+	// Coloring plane using scanline algorithm
+	int planeHeight = 65;
+	fillShape(frame, xPlaneCoordinate, yPlaneCoordinate, 0, planeHeight, planeCoordinates, color);
+}
+
+void traceBomb(Frame *frame, Coord center, RGB color)
+{
+	int panjangBomb = 10;
+	//DrawKiri
+	plotLine(frame, center.x - 3, center.y + panjangBomb / 2, center.x -3, center.y - panjangBomb / 2, color); 
+	
+	//DrawKanan
+	plotLine(frame, center.x + 3, center.y + panjangBomb / 2, center.x + 3, center.y - panjangBomb / 2, color);
+	
+	//DrawAtas
+	plotLine(frame, center.x - 3, center.y - panjangBomb / 2, center.x +3, center.y - panjangBomb / 2, color);
+	
+	//DrawUjungKiri
+	plotLine(frame, center.x - 3, center.y + panjangBomb / 2, center.x, center.y + (panjangBomb / 2 + 4), color);
+	
+	//DrawUjungKanan
+	plotLine(frame, center.x + 3, center.y + panjangBomb / 2, center.x, center.y + (panjangBomb / 2 + 4), color);
+}
+
+// draw shape with its anchor at loc, the way the draw function would
+void traceShape(Frame* frm, int shape, Coord loc, RGB color) {
+	switch (shape) {
+		case spriteShip:
+			traceShip(frm, loc, color);
+			break;
+		case spriteCannon:
+			traceCannon(frm, loc, color);
+			break;
+		case spritePeluru:
+			tracePeluru(frm, loc, color);
+			break;
+		case spritePlane:
+			tracePlane(frm, loc, color);
+			break;
+		case spriteBomb:
+			traceBomb(frm, loc, color);
+			break;
+	}
+}
+
+static SpriteCache spriteCache;
+
+// the cached sprite of shape in color, traced on first use
+Sprite* getSprite(int shape, RGB color) {
+	Frame* scratch = &spriteCache.scratch;
+	Damage* scratchDamage = &spriteCache.scratchDamage;
+	Pixel p = pixel(color);
+	int i, x, y;
+	map<pair<int, Pixel>, Sprite>::iterator it = spriteCache.sprites.find(make_pair(shape, p));
+	if (it != spriteCache.sprites.end()) return &it->second;
+	
+	// trace it around the middle of an empty scratch frame, alpha 0 means uncovered
+	Coord anchor = coord(spriteScratchX/2, spriteScratchY/2);
+	if (!scratch->px && createFrame(scratch, spriteScratchX, spriteScratchY)) {
+		printf("Error: cannot allocate the sprite scratch frame.\n");
+		exit(4);
+	}
+	memset(scratch->px, 0, (size_t)scratch->stride * scratch->height * sizeof(Pixel));
+	scratch->damage = scratchDamage;
+	resetDamage(scratchDamage);
+	traceShape(scratch, shape, anchor, color);
+	Rect box = rect(anchor.x, anchor.y, anchor.x, anchor.y);
+	for (i=0; i<scratchDamage->curCount; i++) {
+		box = rectUnion(box, scratchDamage->cur[i]);
+	}
+	
+	Sprite* spr = &spriteCache.sprites[make_pair(shape, p)];
+	spr->shape = shape;
+	spr->color = p;
+	spr->box = rect(box.x0 - anchor.x, box.y0 - anchor.y, box.x1 - anchor.x, box.y1 - anchor.y);
+	for (y=box.y0; y<box.y1; y++) {
+		x = box.x0;
+		while (x < box.x1) {
+			if (!frameRow(scratch, y)[x]) {
+				x++;
+				continue;
+			}
+			SpriteRun run;
+			run.y = y - anchor.y;
+			run.x0 = x - anchor.x;
+			while (x < box.x1 && frameRow(scratch, y)[x]) x++;
+			run.x1 = x - anchor.x;
+			spr->runs.push_back(run);
+		}
+	}
+	return spr;
+}
+
+// drop every cached sprite and the scratch frame; no Sprite* may be used afterwards
+void destroySpriteCache() {
+	spriteCache.sprites.clear();
+	destroyFrame(&spriteCache.scratch);
+}
+
+void blitSprite(Frame* frm, const Sprite* spr, Coord loc) {
+	Rect box = rect(loc.x + spr->box.x0, loc.y + spr->box.y0, loc.x + spr->box.x1, loc.y + spr->box.y1);
+	markDirty(frm, box.x0, box.y0, box.x1, box.y1);
+	if (frm->renderer) {
+		DrawCmd* cmd = recordCmd(frm, cmdSprite, box, rgb(0,0,0));
+		if (cmd) {
+			cmd->sprite = spr;
+			cmd->x0 = loc.x;
+			cmd->y0 = loc.y;
+		}
+		return;
+	}
+	rasterSprite(frm, spr, loc.x, loc.y);
+}
+
+void drawShip(Frame *frame, Coord center, RGB color) {
+	blitSprite(frame, getSprite(spriteShip, color), center);
+}
+
+void drawCannon(Frame* frm,Coord loc,RGB color){
+	blitSprite(frm, getSprite(spriteCannon, color), loc);
+}
+
+void drawPeluru(Frame *frame, Coord center, RGB color) {
+	blitSprite(frame, getSprite(spritePeluru, color), center);
+}
+
+void drawPlane(Frame *frame, Coord position, RGB color) {
+	blitSprite(frame, getSprite(spritePlane, color), position);
+}
+
+void drawBomb(Frame *frame, Coord center, RGB color) {
+	blitSprite(frame, getSprite(spriteBomb, color), center);
+}
+
+void drawCursor(Frame* frm, Coord loc, RGB color) {
+	plotLine(frm, loc.x - 6, loc.y, loc.x + 6, loc.y, color);
+	plotLine(frm, loc.x, loc.y - 6, loc.x, loc.y + 6, color);
+}
+
+void drawStickman(Frame* frm,Coord loc,int sel,RGB color,int counter){
+	plotCircle(frm,loc.x,loc.y,15,color);
+	plotLine(frm,loc.x,loc.y+15,loc.x,loc.y+50,color);
+	
+	if(counter % 2 == 0){
+		plotLine(frm,loc.x,loc.y+30,loc.x+20,loc.y+sel-3,color);
+		plotLine(frm,loc.x,loc.y+30,loc.x+25,loc.y+(sel+10)-3,color);
+	}else{
+		plotLine(frm,loc.x,loc.y+30,loc.x+20,loc.y+sel,color);
+		plotLine(frm,loc.x,loc.y+30,loc.x+25,loc.y+(sel+10),color);
+	}
+	
+	
+}
+
 void drawStickmanAndCannon(Frame *frame, Coord shipPosition, RGB color, int counter){
 	
 	if(counter % 2 == 0){
@@ -522,33 +2728,11 @@ void drawStickmanAndCannon(Frame *frame, Coord shipPosition, RGB color, int coun
 }
 
 
+// a round: ammunitionWidth-1 columns either side of x, ammunitionLength+1 rows down from y
 void drawAmmunition(Frame *frame, Coord upperBoundPosition, int ammunitionWidth, int ammunitionLength, RGB color){
-	plotLine(frame, upperBoundPosition.x, upperBoundPosition.y, upperBoundPosition.x, upperBoundPosition.y + ammunitionLength, color);
-	
-	int i;
-	for(i = 0; i < ammunitionWidth; i++){
-		plotLine(frame, upperBoundPosition.x + i, upperBoundPosition.y, upperBoundPosition.x + i, upperBoundPosition.y + ammunitionLength, color);
-		plotLine(frame, upperBoundPosition.x - i, upperBoundPosition.y, upperBoundPosition.x - i, upperBoundPosition.y + ammunitionLength, color);
-	}	
-}
-
-void drawPeluru(Frame *frame, Coord center, RGB color)
-{
-	int panjangPeluru = 10;
-	//DrawKiri
-	plotLine(frame, center.x - 3, center.y + panjangPeluru / 2, center.x -3, center.y - panjangPeluru / 2, color); 
-	
-	//DrawKanan
-	plotLine(frame, center.x + 3, center.y + panjangPeluru / 2, center.x + 3, center.y - panjangPeluru / 2, color);
-	
-	//DrawBawah
-	plotLine(frame, center.x - 3, center.y + panjangPeluru / 2, center.x +3, center.y + panjangPeluru / 2, color);
-	
-	//DrawUjungKiri
-	plotLine(frame, center.x - 3, center.y - panjangPeluru / 2, center.x, center.y - (panjangPeluru / 2 + 4), color);
-	
-	//DrawUjungKanan
-	plotLine(frame, center.x + 3, center.y - panjangPeluru / 2, center.x, center.y - (panjangPeluru / 2 + 4), color);
+	int x = upperBoundPosition.x;
+	int y = upperBoundPosition.y;
+	plotRect(frame, rect(x - ammunitionWidth + 1, y, x + ammunitionWidth, y + ammunitionLength + 1), color);
 }
 
 /* Coord moveTowards(Coord position, int angle, int speed)
@@ -559,33 +2743,21 @@ void drawPeluru(Frame *frame, Coord center, RGB color)
 void drawPeluruForRotate(Frame *frame, Coord center, RGB color, int counter)
 {
 	int panjangPeluru = 25;
-	Coord kiriBawah 	= coord(center.x - 6, center.y + panjangPeluru / 2);
-	Coord kananBawah 	= coord(center.x +6, center.y + panjangPeluru / 2);
-	Coord kiriAtas 		= coord(center.x -6, center.y - panjangPeluru / 2);
-	Coord kananAtas		= coord(center.x + 6, center.y - panjangPeluru / 2);
-	Coord ujung			= coord(center.x, center.y - (panjangPeluru / 2 + 4));
-	
-	int temp;
-	
-	temp		=rotasiX(kiriBawah.x,kiriBawah.y,center,counter*10);
-	kiriBawah.y	=rotasiY(kiriBawah.x,kiriBawah.y,center,counter*10);
-	kiriBawah.x	=temp;
-	
-	temp		=rotasiX(kananBawah.x,kananBawah.y,center,counter*10);
-	kananBawah.y=rotasiY(kananBawah.x,kananBawah.y,center,counter*10);
-	kananBawah.x=temp;
-	
-	temp		=rotasiX(kiriAtas.x,kiriAtas.y,center,counter*10);
-	kiriAtas.y	=rotasiY(kiriAtas.x,kiriAtas.y,center,counter*10);
-	kiriAtas.x	=temp;
+	Coord v[5];
+	v[0] = coord(center.x - 6, center.y + panjangPeluru / 2);     // kiri bawah
+	v[1] = coord(center.x + 6, center.y + panjangPeluru / 2);     // kanan bawah
+	v[2] = coord(center.x - 6, center.y - panjangPeluru / 2);     // kiri atas
+	v[3] = coord(center.x + 6, center.y - panjangPeluru / 2);     // kanan atas
+	v[4] = coord(center.x, center.y - (panjangPeluru / 2 + 4));   // ujung
 	
-	temp		=rotasiX(kananAtas.x,kananAtas.y,center,counter*10);
-	kananAtas.y	=rotasiY(kananAtas.x,kananAtas.y,center,counter*10);
-	kananAtas.x	=temp;
-	
-	temp		=rotasiX(ujung.x,ujung.y,center,counter*10);
-	ujung.y		=rotasiY(ujung.x,ujung.y,center,counter*10);
-	ujung.x		=temp;
+	// 10 degrees per step
+	Rotation rot = rotation(center, counter*10);
+	rotateVertices(&rot, v, 5);
+	Coord kiriBawah = v[0];
+	Coord kananBawah = v[1];
+	Coord kiriAtas = v[2];
+	Coord kananAtas = v[3];
+	Coord ujung = v[4];
 	
 	//DrawKiri
 	plotLine(frame, kiriBawah.x, kiriBawah.y, kiriAtas.x, kiriAtas.y, color); 
@@ -629,642 +2801,1589 @@ void drawBaling(Frame *frm , Coord loc,int x1,int x2,int x3,int x4,int y1,int y2
 			x1 = balingCoordinates.at(0).x;
 			y1 = balingCoordinates.at(0).y;
 		}
-		plotLine(frm, x0, y0, x1, y1, color);
+		plotLine(frm, x0, y0, x1, y1, color);
+	}
+
+	int balingHeight = 80;
+	//fillShape(frm, loc.x, loc.y, loc.y-40, balingHeight, balingCoordinates, color);
+
+	// plotLine(frm,loc.x,loc.y,x1,y1,color);
+	// plotLine(frm,loc.x,loc.y,x2,y2,color);
+	// plotLine(frm,x1,y1,x2,y2,color);
+	
+	// plotLine(frm,loc.x,loc.y,x3,y3,rgb(255,0,0));
+	// plotLine(frm,loc.x,loc.y,x4,y4,color);
+	// plotLine(frm,x3,y3,x4,y4,color);
+}
+				
+void rotateBaling(Frame *frm,Coord loc, RGB col ,int counter ){
+	Coord v[4];
+	v[0] = coord(loc.x+40, loc.y+5);
+	v[1] = coord(loc.x+40, loc.y-5);
+	v[2] = coord(loc.x-40, loc.y+5);
+	v[3] = coord(loc.x-40, loc.y-5);
+	
+	// 10 degrees per step
+	Rotation rot = rotation(loc, counter*10);
+	rotateVertices(&rot, v, 4);
+	drawBaling(frm,loc,v[0].x,v[1].x,v[2].x,v[3].x,v[0].y,v[1].y,v[2].y,v[3].y,col);
+}
+
+void rotatePeluru(Frame *frm,Coord loc, RGB col ,int counter)
+{
+	
+}
+void drawBrokenBaling(Frame *frm, Coord loc, RGB color){
+	
+	plotCircle(frm,loc.x+30,loc.y+25,15,color);
+	plotLine(frm,loc.x+30,loc.y,loc.x+70,loc.y+5,color);
+	plotLine(frm,loc.x+30,loc.y,loc.x+70,loc.y-5,color);
+	plotLine(frm,loc.x+70,loc.y+5,loc.x+70,loc.y-5,color);
+	
+	plotLine(frm,loc.x+20,loc.y,loc.x,loc.y+5,color);
+	plotLine(frm,loc.x+20,loc.y,loc.x,loc.y-5,color);
+	plotLine(frm,loc.x,loc.y+5,loc.x,loc.y-5,color);	
+}
+
+void drawParachute(Frame *frame, Coord center, RGB color, int size){
+	int parachuteRadius = size;
+	int parachuteDiameter = parachuteRadius * 2;
+	
+	// solid canopy
+	plotEllipse(frame, center.x, center.y, parachuteRadius, parachuteRadius, 0, 180, 1, color);
+	
+	// parachute bottom border, in the sky's color so the canopy shows its panels
+	plotHalfCircle(frame, center.x - parachuteDiameter / 3, center.y, parachuteRadius / 3, rgb(0,0,0));
+	plotHalfCircle(frame, center.x, center.y, parachuteRadius / 3, rgb(0,0,0));
+	plotHalfCircle(frame, center.x + parachuteDiameter / 3, center.y, parachuteRadius / 3, rgb(0,0,0));
+	
+	// parachute string
+	plotLine(frame, center.x - parachuteRadius, center.y, center.x - parachuteRadius / 6, center.y + parachuteRadius, color); // left
+	plotLine(frame, center.x + parachuteRadius, center.y, center.x + parachuteRadius / 6, center.y + parachuteRadius, color); // right
+	
+	// stickman
+	plotCircle(frame, center.x, center.y + parachuteRadius - parachuteRadius / 12, parachuteRadius / 12, color); //head
+	
+	int bodyStartingPoint = center.y + parachuteRadius - parachuteRadius / 10 + parachuteRadius / 10;
+	plotLine(frame, center.x, bodyStartingPoint, center.x, bodyStartingPoint + parachuteRadius / 5, color); // body
+	
+	int legStartingPoint = bodyStartingPoint + parachuteRadius / 5;
+	plotLine(frame, center.x, legStartingPoint, center.x + parachuteRadius / 13, legStartingPoint + parachuteRadius / 10, color); // right leg
+	plotLine(frame, center.x, legStartingPoint, center.x - parachuteRadius / 13, legStartingPoint + parachuteRadius / 10, color); // left leg
+	
+	plotLine(frame, center.x, bodyStartingPoint, center.x - parachuteRadius / 10, bodyStartingPoint + parachuteRadius / 10, color);
+	plotLine(frame, center.x, bodyStartingPoint, center.x + parachuteRadius / 10, bodyStartingPoint + parachuteRadius / 10, color);
+	plotLine(frame, center.x - parachuteRadius / 10, bodyStartingPoint + parachuteRadius / 10, center.x - parachuteRadius / 6, center.y + parachuteRadius, color);
+	plotLine(frame, center.x + parachuteRadius / 10, bodyStartingPoint + parachuteRadius / 10, center.x + parachuteRadius / 6, center.y + parachuteRadius, color);
+}
+
+Coord lengthEndPoint(Coord startingPoint, int degree, int length){
+	Coord endPoint;
+	
+	int d = degreeIndex(degree);
+	
+	// dividing truncates toward zero like the old int() cast
+	endPoint.x = length * trig.cos[d] / 65536 + startingPoint.x;
+	endPoint.y = length * trig.sin[d] / 65536 + startingPoint.y;
+	
+	return endPoint;
+}
+
+/* WALK CYCLE -------------------------------------------------------- */
+// The walking stickman is a skeleton whose joint angles are keyframed over
+// one walk cycle. Every frame of the cycle is posed once at startup, so a
+// walker only carries its frame number and drawing it is a table lookup.
+
+#define walkFrames 24
+
+//Keyframed values of the skeleton
+enum {
+	channelBob, // the neck's drop below where the walker stands
+	channelRightArm,
+	channelLeftArm,
+	channelRightUpperLeg,
+	channelRightLowerLeg,
+	channelLeftUpperLeg,
+	channelLeftLowerLeg,
+	channelNone // a fixed angle
+};
+
+//Joints of the skeleton, parents before their children
+enum {
+	jointNeck, // the root
+	jointHip,
+	jointRightElbow,
+	jointRightHand,
+	jointLeftElbow,
+	jointLeftHand,
+	jointRightKnee,
+	jointRightFoot,
+	jointLeftKnee,
+	jointLeftFoot,
+	jointCount
+};
+
+//Value of a channel at a frame of the cycle, linear in between
+typedef struct s_keyframe {
+	int channel;
+	int frame;
+	int value;
+} Keyframe;
+
+//Bone from the parent joint to a joint, at the channel's angle plus a fixed one
+typedef struct s_bone {
+	int parent;
+	int length;
+	int channel;
+	int angle;
+} Bone;
+
+//Joints of every frame of the cycle, relative to where the walker stands
+typedef struct s_walkCycle {
+	Coord joint[walkFrames][jointCount];
+} WalkCycle;
+
+// each channel runs from frame 0 to walkFrames, where it is back at its frame 0 value
+static const Keyframe walkKeys[] = {
+	{channelBob, 0, 2}, {channelBob, 2, 0}, {channelBob, 6, 0}, {channelBob, 8, 2}, {channelBob, 12, 2},
+	{channelBob, 14, 0}, {channelBob, 19, 0}, {channelBob, 21, 2}, {channelBob, 24, 2},
+	{channelRightArm, 0, 125}, {channelRightArm, 12, 65}, {channelRightArm, 24, 125},
+	{channelLeftArm, 0, 65}, {channelLeftArm, 12, 125}, {channelLeftArm, 24, 65},
+	{channelRightUpperLeg, 0, 125}, {channelRightUpperLeg, 12, 65}, {channelRightUpperLeg, 24, 125},
+	{channelRightLowerLeg, 0, 95}, {channelRightLowerLeg, 6, 95}, {channelRightLowerLeg, 17, 40},
+	{channelRightLowerLeg, 23, 100}, {channelRightLowerLeg, 24, 95},
+	{channelLeftUpperLeg, 0, 65}, {channelLeftUpperLeg, 12, 125}, {channelLeftUpperLeg, 24, 65},
+	{channelLeftLowerLeg, 0, 65}, {channelLeftLowerLeg, 5, 40}, {channelLeftLowerLeg, 11, 100},
+	{channelLeftLowerLeg, 12, 95}, {channelLeftLowerLeg, 18, 95}, {channelLeftLowerLeg, 24, 65}
+};
+
+// indexed by joint, the root has none
+static const Bone walkBones[jointCount] = {
+	{-1, 0, channelNone, 0},
+	{jointNeck, 50, channelNone, 88},
+	{jointNeck, 30, channelRightArm, 0},
+	{jointRightElbow, 20, channelRightArm, 50},
+	{jointNeck, 30, channelLeftArm, 0},
+	{jointLeftElbow, 20, channelLeftArm, 30},
+	{jointHip, 30, channelRightUpperLeg, 0},
+	{jointRightKnee, 20, channelRightLowerLeg, 0},
+	{jointHip, 30, channelLeftUpperLeg, 0},
+	{jointLeftKnee, 20, channelLeftLowerLeg, 0}
+};
+
+// the channel's value at frame, between the keyframes around it
+int sampleChannel(int channel, int frame) {
+	const Keyframe* prev = NULL;
+	int i;
+	for (i=0; i<(int)(sizeof(walkKeys)/sizeof(walkKeys[0])); i++) {
+		const Keyframe* k = &walkKeys[i];
+		if (k->channel != channel) continue;
+		if (k->frame == frame || (prev && k->frame > frame)) {
+			if (k->frame == frame) return k->value;
+			return prev->value + (k->value - prev->value) * (frame - prev->frame) / (k->frame - prev->frame);
+		}
+		prev = k;
+	}
+	return 0;
+}
+
+WalkCycle makeWalkCycle() {
+	WalkCycle c;
+	int f, j;
+	for (f=0; f<walkFrames; f++) {
+		c.joint[f][jointNeck] = coord(0, sampleChannel(channelBob, f));
+		for (j=1; j<jointCount; j++) {
+			const Bone* b = &walkBones[j];
+			int angle = b->angle + (b->channel == channelNone ? 0 : sampleChannel(b->channel, f));
+			c.joint[f][j] = lengthEndPoint(c.joint[f][b->parent], angle, b->length);
+		}
+	}
+	return c;
+}
+
+const WalkCycle walkCycle = makeWalkCycle();
+
+// draw the stickman at frame of its cycle, standing at loc
+void drawWalkingStickman(Frame *frame, Coord loc, int cycleFrame, RGB color){
+	const Coord* joint = walkCycle.joint[cycleFrame];
+	int j;
+	
+	// head
+	plotCircle(frame, loc.x + joint[jointNeck].x, loc.y + joint[jointNeck].y - 20, 20, color);
+	
+	// bones
+	for (j=1; j<jointCount; j++) {
+		const Coord* a = &joint[walkBones[j].parent];
+		plotLine(frame, loc.x + a->x, loc.y + a->y, loc.x + joint[j].x, loc.y + joint[j].y, color);
+	}
+}
+
+/* ENTITIES ------------------------------------------------------------ */
+// Scene objects are slots in component arrays, advanced by plain passes over
+// all of them at once. Rounds in flight have a pool of their own.
+
+#define ammunitionVelocity 5
+#define ammunitionLength 20
+
+// add an entity at (x,y), with the tick before it at the same place. Returns its slot, -1 when full.
+int spawnEntity(Entities* e, int kind, int x, int y, int vx, int vy, int sprite) {
+	if (e->count >= maxEntities) return -1;
+	int i = e->count++;
+	e->kind[i] = kind;
+	e->alive[i] = 1;
+	e->x[i] = e->prevX[i] = x;
+	e->y[i] = e->prevY[i] = y;
+	e->vx[i] = vx;
+	e->vy[i] = vy;
+	e->wrapX[i] = noWrap;
+	e->wrapToX[i] = 0;
+	e->life[i] = -1;
+	e->sprite[i] = sprite;
+	e->size[i] = 0;
+	e->fireEvery[i] = 0;
+	e->reload[i] = 0;
+	e->anim[i] = 0;
+	return i;
+}
+
+void killEntity(Entities* e, int i) {
+	e->alive[i] = 0;
+	e->vx[i] = 0;
+	e->vy[i] = 0;
+}
+
+// entities that left the canvas on the left come back on the right
+void wrapEntities(Entities* e) {
+	int i;
+	for (i=0; i<e->count; i++) {
+		e->x[i] = e->x[i] <= e->wrapX[i] ? e->wrapToX[i] : e->x[i];
+	}
+}
+
+void integrateEntities(Entities* e) {
+	int i;
+	for (i=0; i<e->count; i++) {
+		e->prevX[i] = e->x[i];
+		e->prevY[i] = e->y[i];
+		e->x[i] += e->vx[i];
+		e->y[i] += e->vy[i];
+	}
+}
+
+// move every entity on to the next frame of its animation
+void animateEntities(Entities* e) {
+	int i;
+	for (i=0; i<e->count; i++) {
+		e->anim[i] = e->anim[i] + 1 == walkFrames ? 0 : e->anim[i] + 1;
+	}
+}
+
+// count lifetimes down, dying at zero
+void ageEntities(Entities* e) {
+	int i;
+	for (i=0; i<e->count; i++) {
+		e->life[i] -= e->life[i] > 0;
+		e->alive[i] &= e->life[i] != 0;
+	}
+}
+
+// fire a round from (x,y). Returns its slot, -1 when the pool is exhausted.
+int spawnProjectile(Projectiles* p, int x, int y, int vx, int vy) {
+	if (p->count >= maxProjectiles) return -1;
+	int i = p->count++;
+	p->x[i] = p->prevX[i] = x;
+	p->y[i] = p->prevY[i] = y;
+	p->vx[i] = vx;
+	p->vy[i] = vy;
+	return i;
+}
+
+// the last live round takes over slot i, so slot numbers don't outlive a despawn
+void despawnProjectile(Projectiles* p, int i) {
+	int last = --p->count;
+	p->x[i] = p->x[last];
+	p->y[i] = p->y[last];
+	p->prevX[i] = p->prevX[last];
+	p->prevY[i] = p->prevY[last];
+	p->vx[i] = p->vx[last];
+	p->vy[i] = p->vy[last];
+}
+
+// move every round, dropping those that went out past the top of the canvas
+void stepProjectiles(Projectiles* p) {
+	int i;
+	for (i=0; i<p->count; i++) {
+		p->prevX[i] = p->x[i];
+		p->prevY[i] = p->y[i];
+		p->x[i] += p->vx[i];
+		p->y[i] += p->vy[i];
+	}
+	for (i=p->count-1; i>=0; i--) {
+		if (p->y[i] <= -ammunitionLength) despawnProjectile(p, i);
+	}
+}
+
+// cannons that are due fire a round from the muzzle
+void fireCannons(Entities* e, Projectiles* p) {
+	int i;
+	for (i=0; i<e->count; i++) {
+		if (!e->alive[i] || e->fireEvery[i] <= 0 || --e->reload[i] > 0) continue;
+		spawnProjectile(p, e->x[i], e->y[i] - 120, 0, -ammunitionVelocity);
+		e->reload[i] = e->fireEvery[i];
+	}
+}
+
+// a ship whose cannon fires every fireEvery ticks, the first time after reload
+int spawnShip(Entities* e, int canvasWidth, int x, int y, int vx, int fireEvery, int reload) {
+	int i = spawnEntity(e, entityShip, x, y, vx, 0, spriteShip);
+	if (i >= 0) {
+		e->wrapX[i] = -85;
+		e->wrapToX[i] = canvasWidth + 80;
+		e->fireEvery[i] = fireEvery;
+		e->reload[i] = reload;
+	}
+	return i;
+}
+
+// a plane and its propeller, which flies along 160 pixels behind
+int spawnPlane(Entities* e, int canvasWidth, int x, int y, int vx) {
+	int i = spawnEntity(e, entityPlane, x, y, vx, 0, spritePlane);
+	if (i < 0) return -1;
+	// hitTarget finds the propeller right after its plane, so both fit or neither does
+	int b = spawnEntity(e, entityBaling, x + 160, y + 10, vx, 0, -1);
+	if (b < 0) {
+		e->count--;
+		return -1;
+	}
+	e->wrapX[i] = -170;
+	e->wrapToX[i] = canvasWidth;
+	e->wrapX[b] = -170 + 160;
+	e->wrapToX[b] = canvasWidth + 160;
+	return i;
+}
+
+/* PARTICLES ----------------------------------------------------------- */
+// Explosions throw sparks and debris as particles. A tick advances all of
+// them in one pass under gravity, bouncing off the floor. Each is drawn as the
+// short streak it left over its last tick.
+
+#define particleGravity 0.15f // pixels per tick, per tick
+#define particleBounce 0.6f // part of its speed a particle keeps bouncing off the floor
+
+// add a particle at (x,y) that lives life ticks. Returns its slot, -1 when the pool is full.
+int spawnParticle(Particles* p, float x, float y, float vx, float vy, int life, RGB color) {
+	if (p->count >= maxParticles) return -1;
+	int i = p->count++;
+	p->x[i] = p->prevX[i] = x;
+	p->y[i] = p->prevY[i] = y;
+	p->vx[i] = vx;
+	p->vy[i] = vy;
+	p->life[i] = life;
+	p->span[i] = life;
+	p->color[i] = color;
+	return i;
+}
+
+// throw count particles out of (x,y) in every direction: three in four are
+// fast, short-lived sparks, the rest slower debris tossed up to fall and bounce
+void emitExplosion(Particles* p, int x, int y, int count, unsigned int* seed) {
+	int i;
+	for (i=0; i<count; i++) {
+		int d = randomRange(seed, 0, 359);
+		if (i % 4) {
+			float speed = randomRange(seed, 20, 120) / 10.0f;
+			spawnParticle(p, x, y, speed * trig.cos[d] / 65536, speed * trig.sin[d] / 65536, randomRange(seed, 10, 24), rgb(255, randomRange(seed, 0, 160), 0));
+		} else {
+			float speed = randomRange(seed, 10, 60) / 10.0f;
+			spawnParticle(p, x, y, speed * trig.cos[d] / 65536, speed * trig.sin[d] / 65536 - 3, randomRange(seed, 90, 180), rgb(99, 99, 99));
+		}
+	}
+}
+
+// move particle from into slot to
+void moveParticle(Particles* p, int to, int from) {
+	p->x[to] = p->x[from];
+	p->y[to] = p->y[from];
+	p->prevX[to] = p->prevX[from];
+	p->prevY[to] = p->prevY[from];
+	p->vx[to] = p->vx[from];
+	p->vy[to] = p->vy[from];
+	p->life[to] = p->life[from];
+	p->span[to] = p->span[from];
+	p->color[to] = p->color[from];
+}
+
+// one tick of every particle, bouncing off floorY. Four at a time with SSE, the
+// bounce picked with a mask; GCC won't if-convert the float compare itself, since
+// it may trap. The dead are packed out afterwards, keeping the order.
+void stepParticles(Particles* p, float floorY) {
+	int i = 0, n;
+	int count = p->count;
+#ifdef HAVE_X86_SIMD
+	const __m128 gravity = _mm_set1_ps(particleGravity);
+	const __m128 bounce = _mm_set1_ps(particleBounce);
+	const __m128 floor4 = _mm_set1_ps(floorY);
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	const __m128i one = _mm_set1_epi32(1);
+	for (; i+4<=count; i+=4) {
+		__m128 x = _mm_load_ps(p->x + i);
+		__m128 y = _mm_load_ps(p->y + i);
+		__m128 vy = _mm_add_ps(_mm_load_ps(p->vy + i), gravity);
+		_mm_store_ps(p->prevX + i, x);
+		_mm_store_ps(p->prevY + i, y);
+		_mm_store_ps(p->x + i, _mm_add_ps(x, _mm_load_ps(p->vx + i)));
+		y = _mm_add_ps(y, vy);
+		__m128 below = _mm_sub_ps(y, floor4);
+		__m128 hit = _mm_cmpgt_ps(below, _mm_setzero_ps());
+		__m128 bouncedY = _mm_sub_ps(floor4, _mm_mul_ps(below, bounce));
+		__m128 bouncedVy = _mm_mul_ps(_mm_xor_ps(vy, sign), bounce);
+		_mm_store_ps(p->y + i, _mm_or_ps(_mm_and_ps(hit, bouncedY), _mm_andnot_ps(hit, y)));
+		_mm_store_ps(p->vy + i, _mm_or_ps(_mm_and_ps(hit, bouncedVy), _mm_andnot_ps(hit, vy)));
+		__m128i life = _mm_load_si128((const __m128i*)(p->life + i));
+		_mm_store_si128((__m128i*)(p->life + i), _mm_sub_epi32(life, one));
+	}
+#endif
+	for (; i<count; i++) {
+		float vy = p->vy[i] + particleGravity;
+		float y = p->y[i] + vy;
+		p->prevX[i] = p->x[i];
+		p->prevY[i] = p->y[i];
+		p->x[i] += p->vx[i];
+		float below = y - floorY;
+		p->y[i] = below > 0 ? floorY - below * particleBounce : y;
+		p->vy[i] = below > 0 ? -vy * particleBounce : vy;
+		p->life[i]--;
+	}
+	for (i=0, n=0; i<p->count; i++) {
+		if (p->life[i] <= 0) continue;
+		if (n != i) moveParticle(p, n, i);
+		n++;
+	}
+	p->count = n;
+}
+
+// the streak particle i left, ending alpha of the way through the tick, in its faded color
+Streak particleStreak(const Particles* p, int i, float alpha) {
+	Streak s;
+	float dx = p->x[i] - p->prevX[i];
+	float dy = p->y[i] - p->prevY[i];
+	float hx = p->prevX[i] + dx * alpha;
+	float hy = p->prevY[i] + dy * alpha;
+	RGB c = p->color[i];
+	s.x1 = (int)floorf(hx + 0.5f);
+	s.y1 = (int)floorf(hy + 0.5f);
+	s.x0 = (int)floorf(hx - dx + 0.5f);
+	s.y0 = (int)floorf(hy - dy + 0.5f);
+	s.color = rgb(c.r * p->life[i] / p->span[i], c.g * p->life[i] / p->span[i], c.b * p->life[i] / p->span[i]);
+	return s;
+}
+
+// bounding box of a streak, limited to clip
+Rect streakBox(const Streak* s, Rect clip) {
+	return rect(max(min(s->x0, s->x1), clip.x0), max(min(s->y0, s->y1), clip.y0), min(max(s->x0, s->x1) + 1, clip.x1), min(max(s->y0, s->y1) + 1, clip.y1));
+}
+
+// draw every particle. Recorded, the streaks are sorted into the tiles they
+// touch, with one command per tile, so tiles never look at each other's.
+void drawParticles(Frame* frm, const Particles* p, float alpha) {
+	Renderer* rdr = frm->renderer;
+	int tilesX = rdr ? rdr->tilesX : 0;
+	int tilesY = rdr ? rdr->tilesY : 0;
+	int* tileStart = rdr ? &rdr->tileStart[0] : NULL;
+	int* tileFill = rdr ? &rdr->tileFill[0] : NULL;
+	Rect dirty = rect(frm->clip.x1, frm->clip.y1, frm->clip.x0, frm->clip.y0);
+	int i, t, tx, ty;
+	
+	if (rdr) {
+		memset(tileStart, 0, (tilesX*tilesY + 1) * sizeof(int));
+	}
+	for (i=0; i<p->count; i++) {
+		Streak s = particleStreak(p, i, alpha);
+		Rect b = streakBox(&s, frm->clip);
+		if (b.x0 >= b.x1 || b.y0 >= b.y1) continue;
+		dirty = rect(min(dirty.x0, b.x0), min(dirty.y0, b.y0), max(dirty.x1, b.x1), max(dirty.y1, b.y1));
+		if (!rdr) {
+			rasterLine(frm, s.x0, s.y0, s.x1, s.y1, s.color);
+			continue;
+		}
+		for (ty=b.y0/tileSize; ty<=(b.y1-1)/tileSize; ty++) {
+			for (tx=b.x0/tileSize; tx<=(b.x1-1)/tileSize; tx++) {
+				tileStart[ty*tilesX + tx + 1]++;
+			}
+		}
+	}
+	if (dirty.x0 >= dirty.x1) return;
+	markDirty(frm, dirty.x0, dirty.y0, dirty.x1, dirty.y1);
+	if (!rdr) return;
+	
+	// lay the tiles' streaks out one after another, then record a command per tile
+	int base = rdr->streaks.size();
+	for (t=0; t<tilesX*tilesY; t++) {
+		tileStart[t+1] += tileStart[t];
+		tileFill[t] = base + tileStart[t];
+	}
+	rdr->streaks.resize(base + tileStart[tilesX*tilesY]);
+	for (i=0; i<p->count; i++) {
+		Streak s = particleStreak(p, i, alpha);
+		Rect b = streakBox(&s, frm->clip);
+		if (b.x0 >= b.x1 || b.y0 >= b.y1) continue;
+		for (ty=b.y0/tileSize; ty<=(b.y1-1)/tileSize; ty++) {
+			for (tx=b.x0/tileSize; tx<=(b.x1-1)/tileSize; tx++) {
+				rdr->streaks[tileFill[ty*tilesX + tx]++] = s;
+			}
+		}
+	}
+	for (t=0; t<tilesX*tilesY; t++) {
+		if (tileStart[t] == tileStart[t+1]) continue;
+		tx = t % tilesX;
+		ty = t / tilesX;
+		DrawCmd* cmd = recordCmd(frm, cmdStreaks, rect(tx*tileSize, ty*tileSize, (tx+1)*tileSize, (ty+1)*tileSize), rgb(0, 0, 0));
+		if (cmd) {
+			cmd->polyStart = base + tileStart[t];
+			cmd->polyCount = tileStart[t+1] - tileStart[t];
+		}
+	}
+}
+
+/* COLLISION ----------------------------------------------------------- */
+// Rounds are points tested against the outlines ships and planes are drawn
+// with. The grid narrows that down to the few targets in the round's cell.
+
+//Called for a round inside a target, returns nonzero when the round is spent
+typedef int (*HitFunc)(void* ctx, int round, int target);
+
+// outline of the entities of kind, NULL when rounds pass through them
+const Coord* kindOutline(int kind, int* count) {
+	switch (kind) {
+		case entityShip:
+			*count = outlineCount(shipOutline);
+			return shipOutline;
+		case entityPlane:
+			*count = outlineCount(planeOutline);
+			return planeOutline;
+	}
+	*count = 0;
+	return NULL;
+}
+
+// is (x,y) inside the polygon? Counts the edges a ray to its right crosses.
+int insideOutline(const Coord* o, int n, int x, int y) {
+	int i, j, inside = 0;
+	for (i=0, j=n-1; i<n; j=i++) {
+		if ((o[i].y > y) == (o[j].y > y)) continue;
+		// left of the edge at row y, compared without dividing
+		long long lhs = (long long)(x - o[j].x) * (o[i].y - o[j].y);
+		long long rhs = (long long)(o[i].x - o[j].x) * (y - o[j].y);
+		inside ^= o[i].y > o[j].y ? lhs < rhs : lhs > rhs;
+	}
+	return inside;
+}
+
+// grid column or row of canvas coordinate v, clamped to the grid
+int collisionCellOf(int v, int cells) {
+	int c = (v + collisionMargin) / collisionCell;
+	return c < 0 ? 0 : c >= cells ? cells - 1 : c;
+}
+
+// file every live target under the cells its box touches
+void buildCollisionGrid(CollisionGrid* g, const Entities* e) {
+	Rect kindBox[entityKinds];
+	int kind, i, n, cx, cy, c;
+	for (kind=0; kind<entityKinds; kind++) {
+		const Coord* o = kindOutline(kind, &n);
+		kindBox[kind] = rect(0, 0, 0, 0);
+		if (!o) continue;
+		kindBox[kind] = rect(o[0].x, o[0].y, o[0].x + 1, o[0].y + 1);
+		for (i=1; i<n; i++) {
+			kindBox[kind].x0 = min(kindBox[kind].x0, o[i].x);
+			kindBox[kind].y0 = min(kindBox[kind].y0, o[i].y);
+			kindBox[kind].x1 = max(kindBox[kind].x1, o[i].x + 1);
+			kindBox[kind].y1 = max(kindBox[kind].y1, o[i].y + 1);
+		}
+	}
+	
+	// count the entries of each cell, then lay the cells out one after another
+	memset(g->cellStart, 0, sizeof(g->cellStart));
+	for (i=0; i<e->count; i++) {
+		const Rect* k = &kindBox[e->kind[i]];
+		if (!e->alive[i] || k->x0 == k->x1) continue;
+		for (cy=collisionCellOf(k->y0 + e->y[i], collisionGridY); cy<=collisionCellOf(k->y1 - 1 + e->y[i], collisionGridY); cy++) {
+			for (cx=collisionCellOf(k->x0 + e->x[i], collisionGridX); cx<=collisionCellOf(k->x1 - 1 + e->x[i], collisionGridX); cx++) {
+				g->cellStart[cy*collisionGridX + cx + 1]++;
+			}
+		}
+	}
+	for (c=0; c<collisionGridX*collisionGridY; c++) {
+		g->cellStart[c+1] += g->cellStart[c];
+		g->cellFill[c] = g->cellStart[c];
+	}
+	for (i=0; i<e->count; i++) {
+		const Rect* k = &kindBox[e->kind[i]];
+		if (!e->alive[i] || k->x0 == k->x1) continue;
+		Rect box = rect(k->x0 + e->x[i], k->y0 + e->y[i], k->x1 + e->x[i], k->y1 + e->y[i]);
+		for (cy=collisionCellOf(box.y0, collisionGridY); cy<=collisionCellOf(box.y1 - 1, collisionGridY); cy++) {
+			for (cx=collisionCellOf(box.x0, collisionGridX); cx<=collisionCellOf(box.x1 - 1, collisionGridX); cx++) {
+				CellEntry* entry = &g->entries[g->cellFill[cy*collisionGridX + cx]++];
+				entry->box = box;
+				entry->target = i;
+			}
+		}
+	}
+}
+
+// report every round inside a live target. Spent rounds are despawned; going
+// backwards, that only ever moves rounds that were tested already.
+void collideProjectiles(const CollisionGrid* g, const Entities* e, Projectiles* p, HitFunc hit, void* ctx) {
+	int i, k, n;
+	for (i=p->count-1; i>=0; i--) {
+		int x = p->x[i];
+		int y = p->y[i];
+		int c = collisionCellOf(y, collisionGridY)*collisionGridX + collisionCellOf(x, collisionGridX);
+		for (k=g->cellStart[c]; k<g->cellStart[c+1]; k++) {
+			const Rect* b = &g->entries[k].box;
+			int t = g->entries[k].target;
+			if (x < b->x0 || x >= b->x1 || y < b->y0 || y >= b->y1 || !e->alive[t]) continue;
+			const Coord* o = kindOutline(e->kind[t], &n);
+			if (!insideOutline(o, n, x - e->x[t], y - e->y[t])) continue;
+			if (hit(ctx, i, t)) {
+				despawnProjectile(p, i);
+				break;
+			}
+		}
+	}
+}
+
+/* SIMULATION ---------------------------------------------------------- */
+// The scene advances in fixed ticks, independent of how fast frames are drawn.
+// A tick runs the wrap-arounds left over from the previous one, moves every
+// entity and round, then plays the story on top: firing, the hit, the bail-out.
+
+#define planeVelocity 10
+#define shipVelocity 5 // velocity (pixel/ tick)
+
+// a stickman standing at (x,y) walking left, at frame of the walk cycle
+int spawnWalker(Entities* e, int canvasWidth, int x, int y, int frame) {
+	int i = spawnEntity(e, entityWalker, x, y, -4, 0, -1);
+	if (i >= 0) {
+		e->wrapX[i] = -70;
+		e->wrapToX[i] = canvasWidth;
+		e->anim[i] = frame;
+	}
+	return i;
+}
+
+void initWorld(World* w, int canvasWidth, int canvasHeight, int fireEvery, int explosionParticles) {
+	Entities* e = &w->entities;
+	e->count = 0;
+	w->projectiles.count = 0;
+	w->particles.count = 0;
+	w->explosionParticles = explosionParticles;
+	w->effectSeed = 1;
+	w->canvasWidth = canvasWidth;
+	w->canvasHeight = canvasHeight;
+	w->tick = -1;
+	w->fireEvery = fireEvery;
+	
+	// plane & ship, whose first round is in the air already
+	w->ship = spawnShip(e, canvasWidth, canvasWidth - 80, 598, -shipVelocity, fireEvery, fireEvery);
+	w->plane = spawnPlane(e, canvasWidth, canvasWidth, 50, -planeVelocity);
+	w->baling = w->plane + 1;
+	spawnProjectile(&w->projectiles, e->x[w->ship], e->y[w->ship] - 120, 0, -ammunitionVelocity);
+	
+	w->isXploded = 0;
+	w->deployed = 0;
+	w->stickmanEncounter = 0;
+}
+
+// add n more ships, planes and walkers at seeded places, for stress scenes
+void spawnCrowd(World* w, int n, unsigned int seed) {
+	Entities* e = &w->entities;
+	unsigned int state = seed;
+	int i;
+	for (i=0; i<n; i++) {
+		// at least a tick between shots, and no overflow for huge --fire-every values
+		int fireEvery = randomRange(&state, max(1, w->fireEvery/2), min(w->fireEvery, 0x3fffffff) * 2);
+		spawnShip(e, w->canvasWidth, randomRange(&state, 0, w->canvasWidth + 80), randomRange(&state, 200, 598), -randomRange(&state, 1, 8), fireEvery, randomRange(&state, 1, fireEvery));
+		spawnPlane(e, w->canvasWidth, randomRange(&state, 0, w->canvasWidth), randomRange(&state, 20, 400), -randomRange(&state, 2, 16));
+		spawnWalker(e, w->canvasWidth, randomRange(&state, 0, w->canvasWidth), randomRange(&state, 100, 560), randomRange(&state, 0, walkFrames - 1));
+	}
+}
+
+// a round hit a ship, which stops it with a few sparks, or a plane, which
+// explodes and goes down. Hitting the first plane carries the story on.
+int hitTarget(void* ctx, int round, int target) {
+	World* w = (World*)ctx;
+	Entities* e = &w->entities;
+	int x = w->projectiles.x[round];
+	int y = w->projectiles.y[round];
+	if (e->kind[target] == entityShip) {
+		emitExplosion(&w->particles, x, y, w->explosionParticles / 16, &w->effectSeed);
+	} else if (e->kind[target] == entityPlane) {
+		int baling = target + 1; // spawned right after its plane
+		killEntity(e, target);
+		e->vx[baling] = 0;
+		e->vy[baling] = planeVelocity;
+		e->wrapX[baling] = noWrap;
+		e->life[baling] = (w->canvasHeight - e->y[baling]) / planeVelocity + 1;
+		emitExplosion(&w->particles, x, y, w->explosionParticles, &w->effectSeed);
+		if (target == w->plane) {
+			w->isXploded = 1;
+		}
+	}
+	return 1;
+}
+
+// advance the scene by one tick
+void stepWorld(World* w) {
+	Entities* e = &w->entities;
+	int canvasWidth = w->canvasWidth;
+	int canvasHeight = w->canvasHeight;
+	Projectiles* p = &w->projectiles;
+	int ship = w->ship;
+	int i;
+	
+	// finish the previous tick
+	wrapEntities(e);
+	ageEntities(e);
+	if(w->deployed && w->parachute >= 0 && !w->stickmanEncounter && e->x[w->parachute] >= canvasWidth + e->size[w->parachute] * 2){
+		w->stickmanEncounter = 1;
+		spawnWalker(e, canvasWidth, 1350, 503, 0);
+	}
+	w->tick++;
+	
+	// the plane was hit: the pilot bails out and the gunner stops
+	if(w->isXploded && !w->deployed){
+		e->fireEvery[ship] = 0;
+		w->deployed = 1;
+		w->parachute = spawnEntity(e, entityParachute, 400, 50, 4, 1, -1); // -1 in a full store
+		if (w->parachute >= 0) {
+			e->size[w->parachute] = 50;
+		}
+	}
+	
+	integrateEntities(e);
+	animateEntities(e);
+	stepProjectiles(p);
+	fireCannons(e, p);
+	stepParticles(&w->particles, canvasHeight - 10);
+	
+	// per-kind behaviour the passes don't cover
+	for (i=0; i<e->count; i++) {
+		if (!e->alive[i]) continue;
+		if (e->kind[i] == entityParachute && e->size[i] <= 150) {
+			e->size[i]++;
+		}
 	}
-
-	int balingHeight = 80;
-	//fillShape(frm, loc.x, loc.y, loc.y-40, balingHeight, balingCoordinates, color);
-
-	// plotLine(frm,loc.x,loc.y,x1,y1,color);
-	// plotLine(frm,loc.x,loc.y,x2,y2,color);
-	// plotLine(frm,x1,y1,x2,y2,color);
 	
-	// plotLine(frm,loc.x,loc.y,x3,y3,rgb(255,0,0));
-	// plotLine(frm,loc.x,loc.y,x4,y4,color);
-	// plotLine(frm,x3,y3,x4,y4,color);
-}
-				
-void rotateBaling(Frame *frm,Coord loc, RGB col ,int counter ){
-	int x1=loc.x+40; int y1=loc.y+5;
-	int x2=loc.x+40; int y2=loc.y-5;
-	int x3=loc.x-40; int y3=loc.y+5;
-	int x4=loc.x-40; int y4=loc.y-5;
-	
-	int temp;
-	temp=rotasiX(x1,y1,loc,counter*10);
-	y1=rotasiY(x1,y1,loc,counter*10);
-	x1=temp;
-	temp=rotasiX(x2,y2,loc,counter*10);
-	y2=rotasiY(x2,y2,loc,counter*10);
-	x2=temp;
-	temp=rotasiX(x3,y3,loc,counter*10);	
-	y3=rotasiY(x3,y3,loc,counter*10);
-	x3=temp;
-	temp=rotasiX(x4,y4,loc,counter*10);
-	y4=rotasiY(x4,y4,loc,counter*10);
-	x4=temp;
-	drawBaling(frm,loc,x1,x2,x3,x4,y1,y2,y3,y4,col);
+	// rounds against ships and planes
+	ProfileScope scope(stageCollide);
+	buildCollisionGrid(&w->grid, e);
+	collideProjectiles(&w->grid, e, p, hitTarget, w);
 }
 
-void rotatePeluru(Frame *frm,Coord loc, RGB col ,int counter)
-{
-	
+// alpha of the way from a to b, unless that is a jump (a wrap-around or a respawn)
+int lerpPosition(int a, int b, float alpha) {
+	if (abs(b - a) > maxTickMove) return b;
+	return a + (int)floorf((b - a) * alpha + 0.5f);
 }
-void drawPlane(Frame *frame, Coord position, RGB color) {
 
-	// Ship's relative coordinate to canvas, ship's actuator
-	int xPlaneCoordinate = position.x;
-	int yPlaneCoordinate = position.y;
+// draw the scene alpha of the way from the tick before to the newest one
+void drawWorld(Frame* frm, const World* w, float alpha) {
+	const Entities* e = &w->entities;
+	int kind, i;
+	for (kind=0; kind<entityKinds; kind++) {
+		for (i=0; i<e->count; i++) {
+			if (!e->alive[i] || e->kind[i] != kind) continue;
+			Coord loc = coord(lerpPosition(e->prevX[i], e->x[i], alpha), lerpPosition(e->prevY[i], e->y[i], alpha));
+			if (e->sprite[i] >= 0) {
+				blitSprite(frm, getSprite(e->sprite[i], rgb(99, 99, 99)), loc);
+			}
+			switch (kind) {
+				case entityShip:
+					drawStickmanAndCannon(frm, loc, rgb(99,99,99), w->tick);
+					break;
+				case entityParachute:
+					drawParachute(frm, loc, rgb(99, 99, 99), e->size[i]);
+					break;
+				case entityWalker:
+					drawWalkingStickman(frm, loc, e->anim[i], rgb(99, 99, 99));
+					break;
+				case entityBaling:
+					// spinning 10 degrees per tick
+					rotateBaling(frm, loc, rgb(255,255,255), -w->tick);
+					break;
+			}
+		}
+	}
 	
-	// Ship's border coordinates
-	vector<Coord>  planeCoordinates;
-	planeCoordinates.push_back(coord(0,31));
-	planeCoordinates.push_back(coord(planeCoordinates.at(0).x + 15, planeCoordinates.at(0).y-5));
-	planeCoordinates.push_back(coord(planeCoordinates.at(1).x + 30, planeCoordinates.at(1).y-3));
-	planeCoordinates.push_back(coord(planeCoordinates.at(2).x + 13, planeCoordinates.at(2).y-4));
-	planeCoordinates.push_back(coord(planeCoordinates.at(3).x + 13, planeCoordinates.at(3).y-3));
-	planeCoordinates.push_back(coord(planeCoordinates.at(4).x + 13, planeCoordinates.at(4).y+5));
-	planeCoordinates.push_back(coord(planeCoordinates.at(5).x + 13, planeCoordinates.at(5).y+4));
-	planeCoordinates.push_back(coord(planeCoordinates.at(6).x + 50, planeCoordinates.at(6).y-3));
-	planeCoordinates.push_back(coord(planeCoordinates.at(7).x + 5, planeCoordinates.at(7).y-18));
-	planeCoordinates.push_back(coord(planeCoordinates.at(8).x + 10, planeCoordinates.at(8).y-4));
-	planeCoordinates.push_back(coord(planeCoordinates.at(9).x + 3, planeCoordinates.at(9).y+27));
-	planeCoordinates.push_back(coord(planeCoordinates.at(10).x - 1, planeCoordinates.at(10).y+5));
-	planeCoordinates.push_back(coord(planeCoordinates.at(11).x + 1, planeCoordinates.at(11).y+5));
-	planeCoordinates.push_back(coord(planeCoordinates.at(12).x - 69, planeCoordinates.at(12).y+4));
-	planeCoordinates.push_back(coord(planeCoordinates.at(13).x + 13, planeCoordinates.at(13).y+25));
-	planeCoordinates.push_back(coord(planeCoordinates.at(14).x - 10, planeCoordinates.at(14).y-6));
-	planeCoordinates.push_back(coord(planeCoordinates.at(15).x - 17, planeCoordinates.at(15).y-18));
-	planeCoordinates.push_back(coord(planeCoordinates.at(16).x - 37, planeCoordinates.at(16).y-2));
-	planeCoordinates.push_back(coord(planeCoordinates.at(17).x - 27, planeCoordinates.at(17).y-4));
+	// rounds, over the live ones only
+	const Projectiles* p = &w->projectiles;
+	for (i=0; i<p->count; i++) {
+		Coord loc = coord(lerpPosition(p->prevX[i], p->x[i], alpha), lerpPosition(p->prevY[i], p->y[i], alpha));
+		blitSprite(frm, getSprite(spritePeluru, rgb(99, 99, 99)), loc);
+		drawAmmunition(frm, loc, 3, ammunitionLength, rgb(99, 99, 99));
+	}
 	
+	// sparks and debris on top of everything
+	drawParticles(frm, &w->particles, alpha);
+}
 
-	// Draw ship's border relative to canvas
-	for(int i = 0; i < planeCoordinates.size(); i++){
-		int x0, y0, x1, y1;
-		
-		if(i < planeCoordinates.size() - 1){
-			x0 = planeCoordinates.at(i).x + xPlaneCoordinate;
-			y0 = planeCoordinates.at(i).y + yPlaneCoordinate;
-			x1 = planeCoordinates.at(i + 1).x + xPlaneCoordinate;
-			y1 = planeCoordinates.at(i + 1).y + yPlaneCoordinate;
-		}else{
-			x0 = planeCoordinates.at(planeCoordinates.size() - 1).x + xPlaneCoordinate;
-			y0 = planeCoordinates.at(planeCoordinates.size() - 1).y + yPlaneCoordinate;
-			x1 = planeCoordinates.at(0).x + xPlaneCoordinate;
-			y1 = planeCoordinates.at(0).y + yPlaneCoordinate;
-		}
-		
-		plotLine(frame, x0, y0, x1, y1, color);
-	}
+/* BENCHMARKS ---------------------------------------------------------- */
+// Times each primitive on seeded random workloads drawn straight into an
+// offscreen frame. A case repeats its batch until benchMinSeconds have
+// passed, so cheap and expensive cases get a similar number of samples.
 
-	// Coloring plane using scanline algorithm
-	int planeHeight = 65;
-	fillShape(frame, xPlaneCoordinate, yPlaneCoordinate, 0, planeHeight, planeCoordinates, color);
+#define benchMinSeconds 0.25
+#define benchWidth 1366 // the screen the numbers have always been taken on
+#define benchHeight 768
+#define benchBatch 512
+
+enum { benchLine, benchLineWidth, benchCircle, benchHalfCircle, benchDisc, benchSmoothDisc, benchSlice, benchFill, benchFlush, benchShowCanvas, benchShowFrame };
+enum { placeOnscreen, placePartial, placeOffscreen };
+
+//One call of a benchmark batch
+typedef struct s_benchOp {
+	int x0;
+	int y0;
+	int x1;
+	int y1;
+	int r;
+	float wd;
+	vector<Coord> poly;
+} BenchOp;
+
+//Measured result of one case
+typedef struct s_benchResult {
+	const char* name;
+	const char* workload;
+	long long calls;
+	long long pixels;
+	double seconds;
+} BenchResult;
+
+// center of a primitive reaching `reach` pixels around it, placed relative to the screen
+Coord benchCenter(unsigned int* state, int placement, int reach) {
+	if (placement == placeOnscreen) {
+		return coord(randomRange(state, reach, benchWidth - 1 - reach), randomRange(state, reach, benchHeight - 1 - reach));
+	}
+	// partial straddles an edge, offscreen sits fully past it
+	int lo = placement == placePartial ? -reach/2 : -2*reach - 1;
+	int hi = placement == placePartial ? reach/2 : -reach - 1;
+	int d = randomRange(state, lo, hi);
+	switch (randomRange(state, 0, 3)) {
+		case 0: return coord(d, randomRange(state, 0, benchHeight - 1));
+		case 1: return coord(benchWidth - 1 - d, randomRange(state, 0, benchHeight - 1));
+		case 2: return coord(randomRange(state, 0, benchWidth - 1), d);
+		default: return coord(randomRange(state, 0, benchWidth - 1), benchHeight - 1 - d);
+	}
 }
 
-void drawExplosion(Frame *frame, Coord loc, int mult, RGB color){	
-	plotLine(frame,loc.x+10*mult,loc.y +10*mult,loc.x+20*mult,loc.y+20*mult,color);
-	plotLine(frame,loc.x-10*mult,loc.y -10*mult,loc.x-20*mult,loc.y-20*mult,color);
-	plotLine(frame,loc.x+10*mult,loc.y -10*mult,loc.x+20*mult,loc.y-20*mult,color);
-	plotLine(frame,loc.x-10*mult,loc.y +10*mult,loc.x-20*mult,loc.y+20*mult,color);
-	plotLine(frame,loc.x,loc.y -10*mult,loc.x,loc.y-20*mult,color);
-	plotLine(frame,loc.x-10*mult,loc.y,loc.x-20*mult,loc.y,color);
-	plotLine(frame,loc.x+10*mult,loc.y ,loc.x+20*mult,loc.y,color);
-	plotLine(frame,loc.x,loc.y +10*mult,loc.x,loc.y+20*mult,color);
+// lines of random slope with lengths in lo..hi
+void benchLines(unsigned int* state, vector<BenchOp>& ops, int placement, int lo, int hi, float wdMax) {
+	int i;
+	ops.resize(benchBatch);
+	for (i=0; i<benchBatch; i++) {
+		BenchOp* op = &ops[i];
+		int len = randomRange(state, lo, hi);
+		int d = randomRange(state, 0, 359);
+		op->wd = wdMax > 1 ? 1 + (randomNext(state) % 1000) * (wdMax - 1) / 1000 : 1;
+		Coord c = benchCenter(state, placement, len/2 + (int)op->wd + 2);
+		int dx = (trig.cos[d] * (len/2)) >> 16;
+		int dy = (trig.sin[d] * (len/2)) >> 16;
+		op->x0 = c.x - dx;
+		op->y0 = c.y - dy;
+		op->x1 = c.x + dx;
+		op->y1 = c.y + dy;
+	}
 }
 
-void animateExplosion(Frame* frame, int explosionMul, Coord loc){
-	int explosionR, explosionG, explosionB;
-	explosionR = explosionG = explosionB = 255-explosionMul*12;	
-	if(explosionR <= 0 || explosionG <= 0 || explosionB <= 0){
-		explosionR = explosionG = explosionB = 0;
+// circles with radii in lo..hi
+void benchCircles(unsigned int* state, vector<BenchOp>& ops, int placement, int lo, int hi) {
+	int i;
+	ops.resize(benchBatch);
+	for (i=0; i<benchBatch; i++) {
+		BenchOp* op = &ops[i];
+		op->r = randomRange(state, lo, hi);
+		Coord c = benchCenter(state, placement, op->r);
+		op->x0 = c.x;
+		op->y0 = c.y;
 	}
-	drawExplosion(frame, loc, explosionMul, rgb(explosionR, 0, 0));
 }
 
-void animateBan(Frame *frm, Coord *loc, RGB color, float *bVel, float *bVelX) {
-	int g = 1;
-	int tV = 1500;
-	float cB = 0.9;
-	if (*bVel < tV) {
-		*bVel = *bVel+g;
+// star-shaped polygons with n vertices and radii in lo..hi, local to their bounding square
+void benchPolygons(unsigned int* state, vector<BenchOp>& ops, int placement, int n, int lo, int hi) {
+	int i, j;
+	ops.resize(benchBatch);
+	for (i=0; i<benchBatch; i++) {
+		BenchOp* op = &ops[i];
+		op->r = randomRange(state, lo, hi);
+		Coord c = benchCenter(state, placement, op->r);
+		op->x0 = c.x - op->r;
+		op->y0 = c.y - op->r;
+		op->poly.resize(n);
+		for (j=0; j<n; j++) {
+			int d = degreeIndex(j * 360 / n + randomRange(state, 0, 360 / n / 2));
+			int rad = randomRange(state, op->r / 2, op->r);
+			op->poly[j] = coord(op->r + ((trig.cos[d] * rad) >> 16), op->r + ((trig.sin[d] * rad) >> 16));
+		}
 	}
-	if (loc->y > 590) {
-		*bVel = (*bVel*-1);
+}
+
+void runBenchOp(int kind, const BenchOp* op, Frame* frm, Frame* cnvs, FrameBuffer* fb, RGB col) {
+	switch (kind) {
+		case benchLine:
+			plotLine(frm, op->x0, op->y0, op->x1, op->y1, col);
+			break;
+		case benchLineWidth:
+			plotLineWidth(frm, op->x0, op->y0, op->x1, op->y1, op->wd, col);
+			break;
+		case benchCircle:
+			plotCircle(frm, op->x0, op->y0, op->r, col);
+			break;
+		case benchHalfCircle:
+			plotHalfCircle(frm, op->x0, op->y0, op->r, col);
+			break;
+		case benchDisc:
+			plotDisc(frm, op->x0, op->y0, op->r, 0, col);
+			break;
+		case benchSmoothDisc:
+			plotDisc(frm, op->x0, op->y0, op->r, 1, col);
+			break;
+		case benchSlice:
+			plotEllipse(frm, op->x0, op->y0, op->r, op->r / 2, op->x0 % 360, op->x0 % 360 + 270, 1, col);
+			break;
+		case benchFill:
+			fillShape(frm, op->x0, op->y0, 0, 2 * op->r, op->poly, col);
+			break;
+		case benchFlush:
+			flushFrame(frm, col);
+			break;
+		case benchShowCanvas:
+			showCanvas(frm, cnvs, coord(benchWidth/2, benchHeight/2), col, 1);
+			break;
+		case benchShowFrame:
+			showFrame(frm, fb);
+			break;
 	}
-	*bVel = *bVel-(*bVel*0.03);
-	*bVelX = *bVelX-(*bVelX*0.03);
-	loc->x = loc->x+*bVelX;
-	loc->y = loc->y+*bVel;
-	plotCircle(frm,loc->x,loc->y,5,color);
 }
 
-void drawBomb(Frame *frame, Coord center, RGB color)
-{
-	int panjangBomb = 10;
-	//DrawKiri
-	plotLine(frame, center.x - 3, center.y + panjangBomb / 2, center.x -3, center.y - panjangBomb / 2, color); 
-	
-	//DrawKanan
-	plotLine(frame, center.x + 3, center.y + panjangBomb / 2, center.x + 3, center.y - panjangBomb / 2, color);
-	
-	//DrawAtas
-	plotLine(frame, center.x - 3, center.y - panjangBomb / 2, center.x +3, center.y - panjangBomb / 2, color);
-	
-	//DrawUjungKiri
-	plotLine(frame, center.x - 3, center.y + panjangBomb / 2, center.x, center.y + (panjangBomb / 2 + 4), color);
-	
-	//DrawUjungKanan
-	plotLine(frame, center.x + 3, center.y + panjangBomb / 2, center.x, center.y + (panjangBomb / 2 + 4), color);
+// run one case until it has taken long enough to measure
+BenchResult runBenchCase(const char* name, const char* workload, int kind, const vector<BenchOp>& ops, Frame* frm, Frame* cnvs, FrameBuffer* fb) {
+	BenchResult res;
+	res.name = name;
+	res.workload = workload;
+	res.calls = 0;
+	res.pixels = 0;
+	size_t n = ops.empty() ? 1 : ops.size();
+	size_t i;
+	long long before = pixelsWritten;
+	double start = nowSeconds();
+	do {
+		for (i=0; i<n; i++) {
+			runBenchOp(kind, ops.empty() ? NULL : &ops[i], frm, cnvs, fb, rgb(i, 255 - i, 128));
+		}
+		res.calls += n;
+		res.seconds = nowSeconds() - start;
+	} while (res.seconds < benchMinSeconds);
+	res.pixels = pixelsWritten - before;
+	return res;
 }
 
-void drawBrokenBaling(Frame *frm, Coord loc, RGB color){
-	
-	plotCircle(frm,loc.x+30,loc.y+25,15,color);
-	plotLine(frm,loc.x+30,loc.y,loc.x+70,loc.y+5,color);
-	plotLine(frm,loc.x+30,loc.y,loc.x+70,loc.y-5,color);
-	plotLine(frm,loc.x+70,loc.y+5,loc.x+70,loc.y-5,color);
-	
-	plotLine(frm,loc.x+20,loc.y,loc.x,loc.y+5,color);
-	plotLine(frm,loc.x+20,loc.y,loc.x,loc.y-5,color);
-	plotLine(frm,loc.x,loc.y+5,loc.x,loc.y-5,color);	
+void printBenchResults(const vector<BenchResult>& results, unsigned int seed, const char* present, int json) {
+	size_t i;
+	if (json) {
+		printf("{\n  \"seed\": %u,\n  \"present\": \"%s\",\n  \"results\": [\n", seed, present);
+	} else {
+		printf("seed %u, present: %s\n", seed, present);
+		printf("%-16s %-22s %10s %12s %10s %10s %14s\n", "primitive", "workload", "calls", "pixels", "ns/call", "ns/pixel", "pixels/s");
+	}
+	for (i=0; i<results.size(); i++) {
+		const BenchResult* r = &results[i];
+		double nsCall = r->seconds * 1e9 / r->calls;
+		double nsPixel = r->pixels ? r->seconds * 1e9 / r->pixels : 0;
+		double rate = r->pixels / r->seconds;
+		if (json) {
+			printf("    {\"primitive\": \"%s\", \"workload\": \"%s\", \"calls\": %lld, \"pixels\": %lld, \"seconds\": %.6f, "
+				"\"ns_per_call\": %.3f, \"ns_per_pixel\": %.4f, \"pixels_per_second\": %.0f}%s\n",
+				r->name, r->workload, r->calls, r->pixels, r->seconds, nsCall, nsPixel, rate, i + 1 < results.size() ? "," : "");
+		} else {
+			printf("%-16s %-22s %10lld %12lld %10.1f %10.3f %14.0f\n", r->name, r->workload, r->calls, r->pixels, nsCall, nsPixel, rate);
+		}
+	}
+	if (json) {
+		printf("  ]\n}\n");
+	}
 }
 
-void drawParachute(Frame *frame, Coord center, RGB color, int size){
-	int parachuteRadius = size;
-	int parachuteDiameter = parachuteRadius * 2;
+// benchmark every drawing primitive; returns the process exit code
+int runBenchmarks(unsigned int seed, int json) {
+	Frame frm, cnvs;
+	if (createFrame(&frm, benchWidth, benchHeight) || createFrame(&cnvs, 1100, 600)) {
+		printf("Error: cannot allocate benchmark frames.\n");
+		return 4;
+	}
+	flushFrame(&cnvs, rgb(10, 20, 30));
 	
-	// parachute upper border
-	plotHalfCircle(frame, center.x, center.y, parachuteRadius, color);
+	FrameBuffer fb;
+	int status = openMemoryOutput(&fb, outputMemory, NULL, benchWidth, benchHeight);
+	if (status) {
+		return status;
+	}
 	
-	// parachute bottom border
-	plotHalfCircle(frame, center.x - parachuteDiameter / 3, center.y, parachuteRadius / 3, color);
-	plotHalfCircle(frame, center.x, center.y, parachuteRadius / 3, color);
-	plotHalfCircle(frame, center.x + parachuteDiameter / 3, center.y, parachuteRadius / 3, color);
+	unsigned int state = seed;
+	vector<BenchOp> ops;
+	vector<BenchResult> results;
 	
-	// parachute string
-	plotLine(frame, center.x - parachuteRadius, center.y, center.x - parachuteRadius / 6, center.y + parachuteRadius, color); // left
-	plotLine(frame, center.x + parachuteRadius, center.y, center.x + parachuteRadius / 6, center.y + parachuteRadius, color); // right
+	benchLines(&state, ops, placeOnscreen, 2, 16, 1);
+	results.push_back(runBenchCase("plotLine", "short on-screen", benchLine, ops, &frm, &cnvs, &fb));
+	benchLines(&state, ops, placeOnscreen, 200, 700, 1);
+	results.push_back(runBenchCase("plotLine", "long on-screen", benchLine, ops, &frm, &cnvs, &fb));
+	benchLines(&state, ops, placePartial, 200, 700, 1);
+	results.push_back(runBenchCase("plotLine", "long partial", benchLine, ops, &frm, &cnvs, &fb));
+	benchLines(&state, ops, placeOffscreen, 200, 700, 1);
+	results.push_back(runBenchCase("plotLine", "long off-screen", benchLine, ops, &frm, &cnvs, &fb));
 	
-	// stickman
-	plotCircle(frame, center.x, center.y + parachuteRadius - parachuteRadius / 12, parachuteRadius / 12, color); //head
+	benchLines(&state, ops, placeOnscreen, 20, 200, 8);
+	results.push_back(runBenchCase("plotLineWidth", "width 1-8 on-screen", benchLineWidth, ops, &frm, &cnvs, &fb));
+	benchLines(&state, ops, placePartial, 20, 200, 8);
+	results.push_back(runBenchCase("plotLineWidth", "width 1-8 partial", benchLineWidth, ops, &frm, &cnvs, &fb));
+	benchLines(&state, ops, placeOffscreen, 20, 200, 8);
+	results.push_back(runBenchCase("plotLineWidth", "width 1-8 off-screen", benchLineWidth, ops, &frm, &cnvs, &fb));
 	
-	int bodyStartingPoint = center.y + parachuteRadius - parachuteRadius / 10 + parachuteRadius / 10;
-	plotLine(frame, center.x, bodyStartingPoint, center.x, bodyStartingPoint + parachuteRadius / 5, color); // body
+	benchCircles(&state, ops, placeOnscreen, 2, 20);
+	results.push_back(runBenchCase("plotCircle", "r 2-20 on-screen", benchCircle, ops, &frm, &cnvs, &fb));
+	benchCircles(&state, ops, placeOnscreen, 50, 300);
+	results.push_back(runBenchCase("plotCircle", "r 50-300 on-screen", benchCircle, ops, &frm, &cnvs, &fb));
+	benchCircles(&state, ops, placePartial, 50, 300);
+	results.push_back(runBenchCase("plotCircle", "r 50-300 partial", benchCircle, ops, &frm, &cnvs, &fb));
+	benchCircles(&state, ops, placeOffscreen, 50, 300);
+	results.push_back(runBenchCase("plotCircle", "r 50-300 off-screen", benchCircle, ops, &frm, &cnvs, &fb));
+	benchCircles(&state, ops, placeOnscreen, 50, 300);
+	results.push_back(runBenchCase("plotHalfCircle", "r 50-300 on-screen", benchHalfCircle, ops, &frm, &cnvs, &fb));
+	benchCircles(&state, ops, placePartial, 50, 300);
+	results.push_back(runBenchCase("plotHalfCircle", "r 50-300 partial", benchHalfCircle, ops, &frm, &cnvs, &fb));
 	
-	int legStartingPoint = bodyStartingPoint + parachuteRadius / 5;
-	plotLine(frame, center.x, legStartingPoint, center.x + parachuteRadius / 13, legStartingPoint + parachuteRadius / 10, color); // right leg
-	plotLine(frame, center.x, legStartingPoint, center.x - parachuteRadius / 13, legStartingPoint + parachuteRadius / 10, color); // left leg
+	benchCircles(&state, ops, placeOnscreen, 2, 20);
+	results.push_back(runBenchCase("plotDisc", "r 2-20 on-screen", benchDisc, ops, &frm, &cnvs, &fb));
+	benchCircles(&state, ops, placeOnscreen, 50, 300);
+	results.push_back(runBenchCase("plotDisc", "r 50-300 on-screen", benchDisc, ops, &frm, &cnvs, &fb));
+	benchCircles(&state, ops, placeOnscreen, 50, 300);
+	results.push_back(runBenchCase("plotDisc", "r 50-300 smooth", benchSmoothDisc, ops, &frm, &cnvs, &fb));
+	benchCircles(&state, ops, placePartial, 50, 300);
+	results.push_back(runBenchCase("plotDisc", "r 50-300 smooth partial", benchSmoothDisc, ops, &frm, &cnvs, &fb));
+	benchCircles(&state, ops, placeOnscreen, 50, 300);
+	results.push_back(runBenchCase("plotEllipse", "270 degree slice smooth", benchSlice, ops, &frm, &cnvs, &fb));
 	
-	plotLine(frame, center.x, bodyStartingPoint, center.x - parachuteRadius / 10, bodyStartingPoint + parachuteRadius / 10, color);
-	plotLine(frame, center.x, bodyStartingPoint, center.x + parachuteRadius / 10, bodyStartingPoint + parachuteRadius / 10, color);
-	plotLine(frame, center.x - parachuteRadius / 10, bodyStartingPoint + parachuteRadius / 10, center.x - parachuteRadius / 6, center.y + parachuteRadius, color);
-	plotLine(frame, center.x + parachuteRadius / 10, bodyStartingPoint + parachuteRadius / 10, center.x + parachuteRadius / 6, center.y + parachuteRadius, color);
-}
-
-Coord lengthEndPoint(Coord startingPoint, int degree, int length){
-	Coord endPoint;
+	benchPolygons(&state, ops, placeOnscreen, 3, 10, 60);
+	results.push_back(runBenchCase("fillShape", "3 vertices small", benchFill, ops, &frm, &cnvs, &fb));
+	benchPolygons(&state, ops, placeOnscreen, 8, 50, 200);
+	results.push_back(runBenchCase("fillShape", "8 vertices", benchFill, ops, &frm, &cnvs, &fb));
+	benchPolygons(&state, ops, placeOnscreen, 32, 50, 200);
+	results.push_back(runBenchCase("fillShape", "32 vertices", benchFill, ops, &frm, &cnvs, &fb));
+	benchPolygons(&state, ops, placeOnscreen, 128, 50, 200);
+	results.push_back(runBenchCase("fillShape", "128 vertices", benchFill, ops, &frm, &cnvs, &fb));
+	benchPolygons(&state, ops, placePartial, 8, 50, 200);
+	results.push_back(runBenchCase("fillShape", "8 vertices partial", benchFill, ops, &frm, &cnvs, &fb));
+	benchPolygons(&state, ops, placeOffscreen, 8, 50, 200);
+	results.push_back(runBenchCase("fillShape", "8 vertices off-screen", benchFill, ops, &frm, &cnvs, &fb));
 	
-	endPoint.x = int((double)length * cos((double)degree * PI / (double)180)) + startingPoint.x;
-	endPoint.y = int((double)length * sin((double)degree * PI / (double)180)) + startingPoint.y;
+	ops.clear();
+	results.push_back(runBenchCase("flushFrame", "full frame", benchFlush, ops, &frm, &cnvs, &fb));
+	results.push_back(runBenchCase("showCanvas", "1100x600 with border", benchShowCanvas, ops, &frm, &cnvs, &fb));
+	results.push_back(runBenchCase("showFrame", "full frame", benchShowFrame, ops, &frm, &cnvs, &fb));
 	
-	return endPoint;
+	printBenchResults(results, seed, fb.presentName, json);
+	closeOutput(&fb);
+	destroyFrame(&frm);
+	destroyFrame(&cnvs);
+	destroySpriteCache();
+	return 0;
 }
 
-void drawWalkingStickman(Frame *frame, Coord center, RGB color){
-	int bodyLength = 50;
-	int rightUpperArmLength = 30;
-	int rightLowerArmLength = 20;
-	int leftUpperArmLength = 30;
-	int leftLowerArmLength = 20;
-	int rightUpperLegLength = 30;
-	int rightLowerLegLength = 20;
-	int leftUpperLegLength = 30;
-	int leftLowerLegLength = 20;
-	
-	static int centerPositionY = center.y;
-	
-	// head
-	plotCircle(frame, center.x, centerPositionY - 20, 20, color);
-	
-	// body	
-	Coord bodyEndPoint = lengthEndPoint(coord(center.x, centerPositionY), 88, bodyLength);
-	plotLine(frame, center.x, centerPositionY, bodyEndPoint.x, bodyEndPoint.y, color);
-	
-	// right upper arm
-	Coord rightUpperArmEndPoint;
-	static int rightUpperArmRotation = 125;
-	{
-		static int moveBackwardArm = 1;
-		
-		if(rightUpperArmRotation == 125){
-			moveBackwardArm = 1;
-		}
-		if(rightUpperArmRotation == 65){
-			moveBackwardArm = 0;
-		}
-		
-		
-		if(moveBackwardArm){
-			rightUpperArmRotation -= 5;
-		}else{
-			rightUpperArmRotation += 5;
+/* PROFILE OVERLAY AND REPORT ----------------------------------------- */
+// The overlay sits in the screen border above the canvas and is drawn into the
+// composition frame every frame. The report is written when the run ends.
+
+#define hudScale 2 // screen pixels per font pixel
+#define hudLineHeight (7*hudScale)
+#define hudMsWidth 40 // overlay bar pixels per millisecond
+#define profileBuckets 50 // 1 ms wide frame time histogram buckets, the last one takes the rest
+
+// 3x5 glyphs, one bit per pixel row by row from the top, the top left one highest
+static const unsigned short hudDigits[10] = {
+	0x7b6f, 0x2c97, 0x73e7, 0x73cf, 0x5bc9, 0x79cf, 0x79ef, 0x7249, 0x7bef, 0x7bcf
+};
+static const unsigned short hudLetters[26] = {
+	0x2bed, 0x6bae, 0x3923, 0x6b6e, 0x79a7, 0x79a4, 0x396b, 0x5bed, 0x7497, 0x126a, 0x5bad, 0x4927, 0x5fed,
+	0x6b6d, 0x2b6a, 0x6ba4, 0x2b73, 0x6bad, 0x388e, 0x7492, 0x5b6f, 0x5b6a, 0x5bfd, 0x5aad, 0x5a92, 0x72a7
+};
+
+static const RGB stageColors[stageCount] = {
+	{99, 99, 255}, {255, 99, 255}, {99, 255, 255}, {99, 99, 99},
+	{99, 255, 99}, {255, 255, 99}, {255, 160, 60}, {200, 200, 200}
+};
+
+unsigned short hudGlyph(char c) {
+	if (c >= '0' && c <= '9') return hudDigits[c - '0'];
+	if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+	if (c >= 'A' && c <= 'Z') return hudLetters[c - 'A'];
+	switch (c) {
+		case '.': return 0x0002;
+		case ':': return 0x0410;
+		case '%': return 0x52a5;
+		case '/': return 0x12a4;
+		case '-': return 0x01c0;
+	}
+	return 0;
+}
+
+// write s with its top left corner at (x,y). Returns the x right after it.
+int drawHudText(Frame* frm, int x, int y, const char* s, RGB color) {
+	int row, col;
+	for (; *s; s++) {
+		unsigned short glyph = hudGlyph(*s);
+		for (row=0; row<5; row++) {
+			for (col=0; col<3; col++) {
+				if (glyph >> (14 - row*3 - col) & 1) {
+					clearRect(frm, rect(x + col*hudScale, y + row*hudScale, x + (col+1)*hudScale, y + (row+1)*hudScale), color);
+				}
+			}
 		}
-		
-		rightUpperArmEndPoint = lengthEndPoint(coord(center.x, centerPositionY), rightUpperArmRotation, rightUpperArmLength);
-		plotLine(frame, center.x, centerPositionY, rightUpperArmEndPoint.x, rightUpperArmEndPoint.y, color);
+		x += 4*hudScale;
 	}
+	return x;
+}
+
+// draw the overlay over the top of frm: the last frame, percentiles and per
+// stage means of the recent ones, and a bar of where the time goes. Returns
+// the area it covers.
+Rect drawHud(Frame* frm, Profiler* prof) {
+	FrameProfile recent[hudFrames];
+	float ms[hudFrames];
+	float stageMs[stageCount];
+	char text[160];
+	int n = recentFrames(prof, recent, hudFrames);
+	int top = 8;
+	int i, s;
+	Rect area = rect(0, 0, frm->width, top + 2*hudLineHeight + 5*hudScale + 2);
+	clearRect(frm, area, rgb(33,33,33));
+	if (n == 0) return area;
 	
-	// right lower arm
-	Coord rightLowerArmEndPoint = lengthEndPoint(coord(rightUpperArmEndPoint.x, rightUpperArmEndPoint.y), rightUpperArmRotation + 50, rightLowerArmLength);
-	plotLine(frame, rightUpperArmEndPoint.x, rightUpperArmEndPoint.y, rightLowerArmEndPoint.x, rightLowerArmEndPoint.y, color);
-	
-	// left upper arm
-	Coord leftUpperArmEndPoint;
-	static int leftUpperArmRotation = 65;
-	{
-		
-		static int moveForwardArm = 1;
-		
-		if(leftUpperArmRotation == 65){
-			moveForwardArm = 1;
-		}
-		if(leftUpperArmRotation == 125){
-			moveForwardArm = 0;
-		}
-		
-		if(moveForwardArm){
-			leftUpperArmRotation += 5;
-		}else{
-			leftUpperArmRotation -= 5;
+	memset(stageMs, 0, sizeof(stageMs));
+	for (i=0; i<n; i++) {
+		ms[i] = recent[i].total;
+		for (s=0; s<stageCount; s++) {
+			stageMs[s] += recent[i].ms[s] / n;
 		}
-		
-		leftUpperArmEndPoint = lengthEndPoint(coord(center.x, centerPositionY), leftUpperArmRotation, leftUpperArmLength);
-		plotLine(frame, center.x, centerPositionY, leftUpperArmEndPoint.x, leftUpperArmEndPoint.y, color);
 	}
+	const FrameProfile* last = &recent[n-1];
+	snprintf(text, sizeof(text), "frame %.2f ms  p50 %.2f  p99 %.2f  px %lld", last->total, frameTimeQuantile(ms, n, 0.5f), frameTimeQuantile(ms, n, 0.99f), last->pixels);
+	drawHudText(frm, 8, top, text, rgb(200,200,200));
 	
-	// left lower arm
-	Coord leftLowerArmEndPoint = lengthEndPoint(coord(leftUpperArmEndPoint.x, leftUpperArmEndPoint.y), leftUpperArmRotation + 30, leftLowerArmLength);
-	plotLine(frame, leftUpperArmEndPoint.x, leftUpperArmEndPoint.y, leftLowerArmEndPoint.x, leftLowerArmEndPoint.y, color);
+	int x = 8;
+	int barX = 8;
+	int barY = top + 2*hudLineHeight;
+	for (s=0; s<stageCount; s++) {
+		snprintf(text, sizeof(text), "%s %.2f", stageNames[s], stageMs[s]);
+		x = drawHudText(frm, x, top + hudLineHeight, text, stageColors[s]) + 8*hudScale;
+		int w = (int)(stageMs[s] * hudMsWidth + 0.5f);
+		clearRect(frm, rect(barX, barY, min(barX + w, frm->width - 8), barY + 3*hudScale), stageColors[s]);
+		barX += w;
+	}
+	// where a frame at 60 fps ends
+	int mark = 8 + hudMsWidth * 1000 / 60;
+	clearRect(frm, rect(mark, barY - hudScale, mark + 1, barY + 4*hudScale), rgb(255,255,255));
+	return area;
+}
+
+// write the kept frames to path, as JSON when it ends in .json and CSV
+// otherwise, and sum them up on stderr
+void writeProfile(Profiler* prof, const char* path) {
+	static FrameProfile frames[profileFrames];
+	static float ms[profileFrames];
+	int histogram[profileBuckets];
+	int n = recentFrames(prof, frames, profileFrames);
+	int json = strlen(path) >= 5 && !strcmp(path + strlen(path) - 5, ".json");
+	double sum = 0;
+	int i, s;
 	
-	// right upper leg
-	Coord rightUpperLegEndPoint;
-	static int rightUpperLegRotation = 125;
-	{
-		static int moveBackwardLeg = 1;
-		
-		if(rightUpperLegRotation == 125){
-			moveBackwardLeg = 1;
-		}
-		if(rightUpperLegRotation == 65){
-			moveBackwardLeg = 0;
-		}
-		
-		if(moveBackwardLeg){
-			rightUpperLegRotation -= 5;
-		}else{
-			rightUpperLegRotation += 5;
-		}
-		
-		rightUpperLegEndPoint = lengthEndPoint(coord(bodyEndPoint.x, bodyEndPoint.y), rightUpperLegRotation, rightUpperLegLength);
-		plotLine(frame, bodyEndPoint.x, bodyEndPoint.y, rightUpperLegEndPoint.x, rightUpperLegEndPoint.y, color);
+	memset(histogram, 0, sizeof(histogram));
+	for (i=0; i<n; i++) {
+		ms[i] = frames[i].total;
+		sum += ms[i];
+		histogram[min(profileBuckets - 1, (int)ms[i])]++;
 	}
+	float p50 = frameTimeQuantile(ms, n, 0.5f);
+	float p99 = frameTimeQuantile(ms, n, 0.99f);
 	
-	// right lower leg
-	{
-		static int rightLowerLegRotation = 95;
-		static int moveBackwardLeg = 1;
-		
-		if(rightUpperLegRotation == 125){
-			moveBackwardLeg = 1;
-			rightLowerLegRotation = 95;
-		}
-		if(rightUpperLegRotation == 65){
-			moveBackwardLeg = 0;
-			rightLowerLegRotation = 70;
-		}
-		
-		if(rightUpperLegRotation <= 90 ){
-			if(moveBackwardLeg){
-				rightLowerLegRotation = rightUpperLegRotation;
-			}else{
-				rightLowerLegRotation -= 5;
-			}
-		}else{
-			if(!moveBackwardLeg){
-				rightLowerLegRotation += 10;
-				if(centerPositionY <= center.y + 1){
-					centerPositionY++;
-				}
-			}else{
-				if(centerPositionY > center.y){
-					centerPositionY--;
-				}
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		fprintf(stderr, "Error: cannot open %s for writing.\n", path);
+		return;
+	}
+	if (json) {
+		fprintf(f, "{\n  \"frames\": [\n");
+		for (i=0; i<n; i++) {
+			fprintf(f, "    {\"frame\": %d", frames[i].frame);
+			for (s=0; s<stageCount; s++) {
+				fprintf(f, ", \"%s\": %.4f", stageNames[s], frames[i].ms[s]);
 			}
+			fprintf(f, ", \"total\": %.4f, \"pixels\": %lld}%s\n", frames[i].total, frames[i].pixels, i+1 < n ? "," : "");
 		}
-
-		Coord rightLowerLegEndPoint = lengthEndPoint(coord(rightUpperLegEndPoint.x, rightUpperLegEndPoint.y), rightLowerLegRotation, rightLowerLegLength);
-		plotLine(frame, rightUpperLegEndPoint.x, rightUpperLegEndPoint.y, rightLowerLegEndPoint.x, rightLowerLegEndPoint.y, color);
-	}
-	
-	// left upper leg
-	Coord leftUpperLegEndPoint;
-	static int leftUpperLegRotation = 65;
-	{
-		static int moveForwardLeg = 1;
-		
-		if(leftUpperLegRotation == 125){
-			moveForwardLeg = 0;
+		fprintf(f, "  ],\n  \"p50\": %.4f,\n  \"p99\": %.4f,\n  \"mean\": %.4f,\n", p50, p99, n ? sum / n : 0);
+		fprintf(f, "  \"histogram\": {\"bucket_ms\": 1, \"counts\": [");
+		for (i=0; i<profileBuckets; i++) {
+			fprintf(f, "%s%d", i ? ", " : "", histogram[i]);
 		}
-		if(leftUpperLegRotation == 65){
-			moveForwardLeg = 1;
+		fprintf(f, "]}\n}\n");
+	} else {
+		fprintf(f, "frame");
+		for (s=0; s<stageCount; s++) {
+			fprintf(f, ",%s", stageNames[s]);
 		}
-		
-		if(moveForwardLeg){
-			leftUpperLegRotation += 5;
-		}else{
-			leftUpperLegRotation -= 5;
+		fprintf(f, ",total,pixels\n");
+		for (i=0; i<n; i++) {
+			fprintf(f, "%d", frames[i].frame);
+			for (s=0; s<stageCount; s++) {
+				fprintf(f, ",%.4f", frames[i].ms[s]);
+			}
+			fprintf(f, ",%.4f,%lld\n", frames[i].total, frames[i].pixels);
 		}
-		
-		leftUpperLegEndPoint = lengthEndPoint(coord(bodyEndPoint.x, bodyEndPoint.y), leftUpperLegRotation, leftUpperLegLength);
-		plotLine(frame, bodyEndPoint.x, bodyEndPoint.y, leftUpperLegEndPoint.x, leftUpperLegEndPoint.y, color);
 	}
+	fclose(f);
 	
-	// left lower leg
-	{
-		static int leftLowerLegRotation = 70;
-		static int moveForwardLeg = 1;
-		
-		if(leftUpperLegRotation == 125){
-			moveForwardLeg = 0;
-			leftLowerLegRotation = 95;
-		}
-		if(leftUpperLegRotation == 65){
-			moveForwardLeg = 1;
-			leftLowerLegRotation = 70;
-		}
-		
-		if(leftUpperLegRotation <= 90 ){
-			if(moveForwardLeg){
-				leftLowerLegRotation -= 5;
-			}else{
-				leftLowerLegRotation = leftUpperLegRotation;
-			}
-		}else{
-			if(moveForwardLeg){
-				leftLowerLegRotation += 10;
-				if(centerPositionY <= center.y + 1){
-					centerPositionY++;
-				}
-			}else{
-				if(centerPositionY > center.y){
-					centerPositionY--;
-				}
-			}
-		}
-		
-		Coord leftLowerLegEndPoint = lengthEndPoint(coord(leftUpperLegEndPoint.x, leftUpperLegEndPoint.y), leftLowerLegRotation, leftLowerLegLength);
-		plotLine(frame, leftUpperLegEndPoint.x, leftUpperLegEndPoint.y, leftLowerLegEndPoint.x, leftLowerLegEndPoint.y, color);
+	fprintf(stderr, "profile: %d frames, mean %.3f ms, p50 %.3f ms, p99 %.3f ms, written to %s\n", n, n ? sum / n : 0, p50, p99, path);
+	fprintf(stderr, "frame time histogram (ms: frames):");
+	for (i=0; i<profileBuckets; i++) {
+		if (histogram[i]) fprintf(stderr, " %d%s: %d", i, i == profileBuckets - 1 ? "+" : "", histogram[i]);
 	}
+	fprintf(stderr, "\n");
 }
 
 /* MAIN FUNCTION ------------------------------------------------------- */
-int main() {	
+int main(int argc, char** argv) {	
 	/* Preparations ---------------------------------------------------- */
 	
-	// get fb and screenInfos
-	struct fb_var_screeninfo vInfo; // variable screen info
-	struct fb_fix_screeninfo sInfo; // static screen info
-	int fbFile;	 // frame buffer file descriptor
-	fbFile = open("/dev/fb0",O_RDWR);
-	if (!fbFile) {
-		printf("Error: cannot open framebuffer device.\n");
-		exit(1);
+	// options
+	int wantFlip = 1;
+	int wantVsync = 0;
+	int threadCount = thread::hardware_concurrency();
+	int output = outputFramebuffer;
+	const char* outputPath = "/dev/fb0";
+	const char* mousePath = "/dev/input/mice";
+	int memoryWidth = defaultScreenX; // screen size of the memory outputs
+	int memoryHeight = defaultScreenY;
+	int frameLimit = 0; // 0 runs forever
+	int tickRate = defaultTickRate;
+	int maxFps = 0; // 0 draws as fast as it can
+	int lockstep = -1; // one tick per frame; by default only when recording to a file
+	int crowd = 0; // extra ships, planes and walkers
+	int fireEvery = cannonFireTicks;
+	int particles = defaultExplosionParticles;
+	int hud = 0;
+	const char* profilePath = NULL; // report written at the end
+	int bench = 0;
+	int benchJson = 0;
+	unsigned int benchSeed = 12345;
+	int arg;
+	for (arg=1; arg<argc; arg++) {
+		if (!strcmp(argv[arg], "--no-flip")) {
+			wantFlip = 0;
+		} else if (!strcmp(argv[arg], "--vsync")) {
+			wantVsync = 1;
+		} else if (!strcmp(argv[arg], "--threads") && arg+1 < argc) {
+			threadCount = atoi(argv[++arg]);
+		} else if (!strcmp(argv[arg], "--frames") && arg+1 < argc) {
+			frameLimit = atoi(argv[++arg]);
+		} else if (!strcmp(argv[arg], "--tick-rate") && arg+1 < argc) {
+			tickRate = atoi(argv[++arg]);
+			tickRate = max(1, tickRate);
+		} else if (!strcmp(argv[arg], "--fps") && arg+1 < argc) {
+			maxFps = atoi(argv[++arg]);
+		} else if (!strcmp(argv[arg], "--lockstep")) {
+			lockstep = 1;
+		} else if (!strcmp(argv[arg], "--realtime")) {
+			lockstep = 0;
+		} else if (!strcmp(argv[arg], "--crowd") && arg+1 < argc) {
+			crowd = atoi(argv[++arg]);
+		} else if (!strcmp(argv[arg], "--fire-every") && arg+1 < argc) {
+			fireEvery = atoi(argv[++arg]);
+			fireEvery = max(1, fireEvery);
+		} else if (!strcmp(argv[arg], "--particles") && arg+1 < argc) {
+			particles = atoi(argv[++arg]);
+		} else if (!strcmp(argv[arg], "--size") && arg+1 < argc) {
+			// WIDTHxHEIGHT, for the memory outputs; the framebuffer has its own
+			if (sscanf(argv[++arg], "%dx%d", &memoryWidth, &memoryHeight) != 2 || memoryWidth < 16 || memoryHeight < 16) {
+				printf("Error: bad size %s.\n", argv[arg]);
+				exit(1);
+			}
+		} else if (!strcmp(argv[arg], "--mouse") && arg+1 < argc) {
+			mousePath = argv[++arg];
+		} else if (!strcmp(argv[arg], "--hud")) {
+			hud = 1;
+		} else if (!strcmp(argv[arg], "--profile") && arg+1 < argc) {
+			profilePath = argv[++arg];
+		} else if (!strcmp(argv[arg], "--bench")) {
+			bench = 1;
+		} else if (!strcmp(argv[arg], "--json")) {
+			benchJson = 1;
+		} else if (!strcmp(argv[arg], "--seed") && arg+1 < argc) {
+			// a plain positive number that fits: strtoul alone takes "12abc" and wraps "-1"
+			const char* text = argv[++arg];
+			char* end;
+			errno = 0;
+			unsigned long seed = strtoul(text, &end, 10);
+			benchSeed = seed;
+			if (text[0] < '0' || text[0] > '9' || *end || errno || seed != benchSeed || !benchSeed) {
+				printf("Error: bad seed %s, it must be a number from 1 to %u.\n", argv[arg], UINT_MAX);
+				exit(1);
+			}
+		} else if (!strcmp(argv[arg], "--output") && arg+1 < argc) {
+			// fb[:device], memory, ppm:file or raw:file
+			const char* spec = argv[++arg];
+			if (!strncmp(spec, "fb:", 3)) {
+				output = outputFramebuffer;
+				outputPath = spec + 3;
+			} else if (!strcmp(spec, "fb")) {
+				output = outputFramebuffer;
+			} else if (!strcmp(spec, "memory")) {
+				output = outputMemory;
+			} else if (!strncmp(spec, "ppm:", 4)) {
+				output = outputPPM;
+				outputPath = spec + 4;
+			} else if (!strncmp(spec, "raw:", 4)) {
+				output = outputRaw;
+				outputPath = spec + 4;
+			} else {
+				printf("Error: unknown output %s.\n", spec);
+				exit(1);
+			}
+		}
 	}
-	if (ioctl (fbFile, FBIOGET_FSCREENINFO, &sInfo)) {
-		printf("Error reading fixed information.\n");
-		exit(2);
+	
+	if (bench) {
+		return runBenchmarks(benchSeed, benchJson);
 	}
-	if (ioctl (fbFile, FBIOGET_VSCREENINFO, &vInfo)) {
-		printf("Error reading variable information.\n");
-		exit(3);
+	if (lockstep < 0) {
+		lockstep = output == outputPPM || output == outputRaw;
 	}
 	
 	// create the FrameBuffer struct with its important infos.
 	FrameBuffer fb;
-	fb.smemLen = sInfo.smem_len;
-	fb.lineLen = sInfo.line_length;
-	fb.bpp = vInfo.bits_per_pixel;
-	
-	// and map the framebuffer to the FB struct.
-	fb.ptr = (char*)mmap(0, sInfo.smem_len, PROT_READ | PROT_WRITE, MAP_SHARED, fbFile, 0);
-	if ((long int)fb.ptr == -1) {
-		printf ("Error: failed to map framebuffer device to memory.\n");
-		exit(4);
+	int status;
+	if (output == outputFramebuffer) {
+		status = openFramebufferOutput(&fb, outputPath, wantFlip, wantVsync);
+	} else {
+		status = openMemoryOutput(&fb, output, outputPath, memoryWidth, memoryHeight);
+	}
+	if (status) {
+		exit(status);
 	}
 	
-	// prepare mouse controller
-	FILE *fmouse;
-	char mouseRaw[3];
-	fmouse = fopen("/dev/input/mice","r");
-	Coord mouse; // mouse internal counter
-	mouse.x = 0;
-	mouse.y = 0;
-		
 	// prepare environment controller
 	unsigned char loop = 1; // frame loop controller
-	Frame cFrame; // composition frame (Video RAM)
+	int frameCount = 0;
+	int i; //for drawing.
+	Frame cFrame; // composition frame (Video RAM), as big as the screen
+	Frame canvas; // only as big as the part of the screen it covers
+	int canvasWidth = min(1100, fb.width - 2); // with room for the border
+	int canvasHeight = min(600, fb.height - 2);
+	static Arena surfaces; // both frames, on huge pages when we can get them
+	if (createArena(&surfaces, frameBytes(fb.width, fb.height) + frameBytes(canvasWidth, canvasHeight) + 64)
+		|| createArenaFrame(&surfaces, &cFrame, fb.width, fb.height) || createArenaFrame(&surfaces, &canvas, canvasWidth, canvasHeight)) {
+		printf("Error: cannot allocate frames.\n");
+		exit(4);
+	}
 	
-	// prepare canvas
-	Frame canvas;
+	// track what gets drawn on the canvas
+	Damage canvasDamage;
+	resetDamage(&canvasDamage);
+	canvas.damage = &canvasDamage;
 	flushFrame(&canvas, rgb(0,0,0));
-	int canvasWidth = 1100;
-	int canvasHeight = 600;
-	Coord canvasPosition = coord(screenX/2,screenY/2);
+	Coord canvasPosition = coord(fb.width/2,fb.height/2);
+	Coord canvasOrigin = coord(canvasPosition.x - canvasWidth/2, canvasPosition.y - canvasHeight/2);
+	
+	// only the canvas changes from frame to frame, so compose and show the rest once (on every page)
+	flushFrame(&cFrame, rgb(33,33,33));
+	showCanvas(&cFrame, &canvas, canvasPosition, rgb(99,99,99), 1);
+	for (i=0; i<fb.pageCount; i++) {
+		showFrame(&cFrame, &fb);
+		if (flipPage(&fb)) {
+			showFrame(&cFrame, &fb);
+		}
+	}
+	Rect changed[maxDirtyRects];
+	int changedCount;
+	
+	// with more than one core, canvas drawing is recorded and rasterized in parallel tiles
+	Renderer renderer;
+	if (threadCount > 1) {
+		startRenderer(&renderer, threadCount, canvasWidth, canvasHeight);
+		canvas.renderer = &renderer;
+	}
 		
-	// prepare plane & ship
-	int planeVelocity = 10;
-	int shipVelocity = 5; // velocity (pixel/ loop)
-	
-	int shipXPosition = canvasWidth - 80;
-	int shipYPosition = 598;
-
-	int planeXPosition = canvasWidth;
-	int planeYPosition = 50;
-	int balingXPosition = planeXPosition+120;
-	int balingYPosition = planeYPosition + 10;
-	int explosionMul = 0;
-	
-	// prepare ammunition
-	Coord firstAmmunitionCoordinate;
-	int isFirstAmmunitionReleased = 1;
-	Coord secondAmmunitionCoordinate;
-	int isSecondAmmunitionReleased = 0;
-	int ammunitionVelocity = 5;
-	int ammunitionLength = 20;
-	
-	firstAmmunitionCoordinate.x = shipXPosition;
-	firstAmmunitionCoordinate.y = shipYPosition - 120;
-	secondAmmunitionCoordinate.y = shipYPosition - 120;	
+	// the scene, too big for the stack
+	static World world;
+	initWorld(&world, canvasWidth, canvasHeight, fireEvery, particles);
+	spawnCrowd(&world, crowd, 1);
+	double tickSeconds = 1.0 / tickRate;
+	double lag = 0; // simulation time not yet covered by a tick
+	int tickCount = 0;
 	
-	int i; //for drawing.
-	int MoveLeft = 1;
-	int stickmanCounter = 0;
-	
-	int isXploded = 0;
-	Coord coordXplosion;
-	int balingCounter=0;
-	
-	int chuteX = 400;
-	int chuteY = 50;
-	int stickmanX = 1350;
-	int stickmanEncounter = 0;
-	int chutesize = 50;
-	int deployed = 0;
-	
-	float bVel = -5;
-	float bVelX = 5;
-	Coord coordBan;
-	coordBan.x = canvasWidth/2;
-	coordBan.y = canvasHeight/2;
+	// frame timing, for the overlay and the report
+	static Profiler frameProfiler;
+	if (hud || profilePath) {
+		initProfiler(&frameProfiler);
+		profiler = &frameProfiler;
+	}
+	
+	// mouse and keys, read on their own thread
+	static Input input;
+	if (startInput(&input, mousePath, fb.width, fb.height)) {
+		printf("Error: cannot start the input thread.\n");
+		exit(5);
+	}
+	Coord cursor = coord(-1,-1); // where the mouse last was, none yet
 	
 	/* Main Loop ------------------------------------------------------- */
 	
+	double runStart = nowSeconds();
+	double lastTime = runStart;
+	double nextRender = runStart;
+	
 	while (loop) {
+		long long pixelsBefore = pixelsWritten + (canvas.renderer ? renderer.workerPixels.load() : 0);
+		if (profiler) {
+			beginFrameProfile(profiler);
+		}
 		
-		// clean composition frame
-		flushFrame(&cFrame, rgb(33,33,33));
-				
-		showCanvas(&cFrame, &canvas, canvasWidth, canvasHeight, canvasPosition, rgb(99,99,99), 1);
-		
-		// clean canvas
-		flushFrame(&canvas, rgb(0,0,0));
-		
-		// draw ship
-		drawShip(&canvas, coord(shipXPosition -= shipVelocity,shipYPosition), rgb(99,99,99));
-		
-		// draw stickman and cannon
-		drawStickmanAndCannon(&canvas, coord(shipXPosition,shipYPosition), rgb(99,99,99), stickmanCounter++);
-		
-		// draw plane
-		if(isXploded == 0)
-			drawPlane(&canvas, coord(planeXPosition -= planeVelocity, planeYPosition), rgb(99, 99, 99));
-		
-		// draw parachute
-		if(isXploded){
-			deployed = 1;
-		}
-		if(deployed)
-		{
-			if(chutesize <= 150){
-				chutesize++;
+		// whatever came in since the last frame; q or ctrl-c quits
+		InputEvent ev;
+		while (popInput(&input.queue, &ev)) {
+			if (ev.type == inputCursor) {
+				cursor = ev.cursor;
+			} else if (ev.key == 'q' || ev.key == 'Q' || ev.key == 3) {
+				loop = 0;
 			}
-			drawParachute(&canvas, coord(chuteX+=4, chuteY+=1), rgb(99, 99, 99), chutesize);
-			animateBan(&canvas, &coordBan, rgb(255, 99, 99), &bVel, &bVelX);
 		}
 		
-		if(stickmanEncounter){
-			drawWalkingStickman(&canvas, coord(stickmanX -= 4, 503), rgb(99, 99, 99));
-		}
-		if(deployed)
-		{
-			rotateBaling(&canvas,coord(planeXPosition + 160,balingYPosition+=planeVelocity),rgb(255,255,255),balingCounter--);
-		}
-		else
-		{
-			rotateBaling(&canvas,coord(planeXPosition + 160,planeYPosition+10),rgb(255,255,255),balingCounter--);
-		}
-	
-		//drawBrokenBaling(&canvas,coord(300,300),rgb(255,255,255));
-
-		// stickman ammunition
-		if(isFirstAmmunitionReleased && !deployed){
-			firstAmmunitionCoordinate.y-=ammunitionVelocity;
-			
-			if(firstAmmunitionCoordinate.y <= canvasHeight/3 && !isSecondAmmunitionReleased){
-				isSecondAmmunitionReleased = 1;
-				secondAmmunitionCoordinate.x = shipXPosition;
-				secondAmmunitionCoordinate.y = shipYPosition - 120;
+		// run the ticks that are due. Lockstep runs exactly one per frame and shows
+		// it as is, otherwise a slow frame is caught up on with several ticks and
+		// the frame shows the scene part of the way into the next one.
+		float alpha = 1;
+		profileStage(stageTick);
+		if (lockstep) {
+			stepWorld(&world);
+			tickCount++;
+		} else {
+			double now = nowSeconds();
+			int ticks = 0;
+			lag += now - lastTime;
+			lastTime = now;
+			while (lag >= tickSeconds && ticks < maxTicksPerFrame) {
+				stepWorld(&world);
+				lag -= tickSeconds;
+				ticks++;
 			}
-			
-			if(firstAmmunitionCoordinate.y <= -ammunitionLength){
-				isFirstAmmunitionReleased = 0;
+			if (lag >= tickSeconds) {
+				lag = 0;
 			}
-			
-			drawPeluru(&canvas, firstAmmunitionCoordinate, rgb(99, 99, 99));
-			drawAmmunition(&canvas, firstAmmunitionCoordinate, 3, ammunitionLength, rgb(99, 99, 99));
+			tickCount += ticks;
+			alpha = lag / tickSeconds;
 		}
 		
-		if(isSecondAmmunitionReleased && !deployed){
-			secondAmmunitionCoordinate.y-=ammunitionVelocity;
-			
-			if(secondAmmunitionCoordinate.y <= canvasHeight/3 && !isFirstAmmunitionReleased){
-				isFirstAmmunitionReleased = 1;
-				firstAmmunitionCoordinate.x = shipXPosition;
-				firstAmmunitionCoordinate.y = shipYPosition - 120;
-			}
-			
-			if(secondAmmunitionCoordinate.y <= 0){
-				isSecondAmmunitionReleased = 0;
+		// compose the canvas regions that changed since the last frame
+		profileStage(stageCompose);
+		changedCount = collectDamage(&canvasDamage, changed); // already within the canvas clip
+		if (fb.pageCount > 1) {
+			// straight into the hidden page, which is two frames behind
+			queuePageDamage(&fb, changed, changedCount);
+			Rect* pending = fb.pending[fb.backPage];
+			for (i=0; i<fb.pendingCount[fb.backPage]; i++) {
+				presentFrameRect(&canvas, &fb, pending[i], canvasOrigin.x + pending[i].x0, canvasOrigin.y + pending[i].y0);
 			}
-			
-			drawPeluru(&canvas, secondAmmunitionCoordinate, rgb(99, 99, 99));
-			drawAmmunition(&canvas, secondAmmunitionCoordinate, 3, ammunitionLength, rgb(99, 99, 99));
-		}
-			
-		//explosion
-		if (isInBound(coord(firstAmmunitionCoordinate.x, firstAmmunitionCoordinate.y), coord(planeXPosition-5, planeYPosition-15), coord(planeXPosition+170, planeYPosition+15))) {
-			coordXplosion = firstAmmunitionCoordinate;
-			isXploded = 1;
-			//printf("boom");
-		} else if (isInBound(coord(secondAmmunitionCoordinate.x, secondAmmunitionCoordinate.y), coord(planeXPosition-5, planeYPosition-15), coord(planeXPosition+170, planeYPosition+15))) {
-			coordXplosion = secondAmmunitionCoordinate;
-			isXploded = 1;
-			//printf("boom");
-		}
-		if (isXploded == 1) {
-			animateExplosion(&canvas, explosionMul, coordXplosion);
-			explosionMul++;
-			if(explosionMul >= 20){
-				explosionMul = 0;
-				//isXploded = 0;
+			fb.pendingCount[fb.backPage] = 0;
+		} else {
+			for (i=0; i<changedCount; i++) {
+				showCanvasRect(&cFrame, &canvas, canvasPosition, changed[i]);
 			}
 		}
 		
-		if(planeXPosition <= -170){
-			planeXPosition = canvasWidth;
-			balingXPosition = canvasWidth + 120;
-		}
+		// clean what was drawn on the canvas last frame
+		profileStage(stageFlush);
+		flushDamage(&canvas, rgb(0,0,0));
 		
-		if(planeXPosition == screenX/2 - canvasWidth/2 - 165){
-			planeXPosition = screenX/2 + canvasWidth/2;
+		profileStage(stageDraw);
+		drawWorld(&canvas, &world, alpha);
+		if (cursor.x >= canvasOrigin.x && cursor.x < canvasOrigin.x + canvasWidth && cursor.y >= canvasOrigin.y && cursor.y < canvasOrigin.y + canvasHeight) {
+			drawCursor(&canvas, coord(cursor.x - canvasOrigin.x, cursor.y - canvasOrigin.y), rgb(255,255,255));
 		}
 		
-		if(shipXPosition <= -85){
-			shipXPosition = canvasWidth + 80;
+		// rasterize what was recorded
+		if (canvas.renderer) {
+			profileStage(stageRaster);
+			renderFrame(&renderer, &canvas);
 		}
 		
-		if(stickmanX <= -70){
-			stickmanX = canvasWidth;
+		// the overlay, made of the frames before this one
+		if (hud) {
+			profileStage(stageHud);
+			showFrameRect(&cFrame, &fb, drawHud(&cFrame, profiler));
 		}
 		
-		if(planeXPosition == screenX/2 - canvasWidth/2 - 165){
-			planeXPosition = screenX/2 + canvasWidth/2;
+		//show frame, only where the canvas changed
+		profileStage(stageShow);
+		if (fb.pageCount > 1) {
+			if (flipPage(&fb)) {
+				// the canvas went straight to the pages, so cFrame missed it too
+				showCanvasRect(&cFrame, &canvas, canvasPosition, rect(0, 0, canvasWidth, canvasHeight));
+				showFrame(&cFrame, &fb);
+			}
+		} else {
+			for (i=0; i<changedCount; i++) {
+				Rect r = changed[i];
+				showFrameRect(&cFrame, &fb, rect(r.x0 + canvasOrigin.x, r.y0 + canvasOrigin.y, r.x1 + canvasOrigin.x, r.y1 + canvasOrigin.y));
+			}
 		}
-		
-		if(chuteX >= canvasWidth + chutesize * 2){
-			stickmanEncounter = 1;
+		endFrame(&fb);
+		if (profiler) {
+			endFrameProfile(profiler, pixelsWritten + (canvas.renderer ? renderer.workerPixels.load() : 0) - pixelsBefore);
 		}
 		
-		//show frame
-		showFrame(&cFrame,&fb);
+		if (frameLimit && ++frameCount >= frameLimit) {
+			loop = 0;
+		}
 		
+		// cap the frame rate; a late frame restarts the schedule instead of rushing the next ones
+		if (maxFps > 0) {
+			nextRender += 1.0 / maxFps;
+			double wait = nextRender - nowSeconds();
+			if (wait > 0) {
+				usleep(wait * 1e6);
+			} else {
+				nextRender = nowSeconds();
+			}
+		}
+	}
+	
+	double seconds = nowSeconds() - runStart;
+	if (frameLimit) {
+		fprintf(stderr, "%d frames, %d ticks in %.3f s (%.1f fps, present: %s, pages: %s)\n", frameCount, tickCount, seconds, frameCount / seconds, fb.presentName, surfaces.pages);
+	}
+
+	if (profilePath) {
+		writeProfile(profiler, profilePath);
 	}
 
 	/* Cleanup --------------------------------------------------------- */
-	munmap(fb.ptr, sInfo.smem_len);
-	close(fbFile);
-	fclose(fmouse);
+	stopInput(&input);
+	if (canvas.renderer) {
+		stopRenderer(&renderer);
+	}
+	closeOutput(&fb);
+	destroyFrame(&canvas);
+	destroyFrame(&cFrame);
+	destroyArena(&surfaces);
+	destroySpriteCache();
 	return 0;
 }